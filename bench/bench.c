@@ -0,0 +1,341 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times the CLI hot paths in isolation, with warm and cold CPU caches,
+ * and reports ns/op and allocations/op for each. Allocations are counted
+ * by wrapping malloc and friends at link time (see Makefile.am). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "cache.h"
+#include "parser.h"
+
+#define SCRUB_SIZE (64 * 1024 * 1024)
+#define LEXER_LINES 100000
+
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+
+YY_BUFFER_STATE yy_scan_string(const char *s);
+void yy_delete_buffer(YY_BUFFER_STATE b);
+int yylex();
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+static size_t allocs = 0;
+static size_t alloc_bytes = 0;
+
+void *__wrap_malloc(size_t size)
+{
+    allocs++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    allocs++;
+    alloc_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    allocs++;
+    alloc_bytes += size;
+    return __real_realloc(p, size);
+}
+
+struct bench {
+    const char *name;
+    void (*setup)();
+    void (*run)();
+    size_t ops;
+    size_t iters;
+};
+
+static volatile size_t sink;
+static char *scrub_buf;
+static char *lexer_input;
+
+static unsigned long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static void scrub_caches()
+{
+    size_t i;
+    for (i = 0; i < SCRUB_SIZE; i += 64) {
+        scrub_buf[i]++;
+    }
+}
+
+static void lexer_setup()
+{
+    static const char *lines[] = {
+        "A vie-bud\n",
+        "F nth s lon-bel\n",
+        "F ion c tun-nap\n",
+        "bud gal h\n",
+        "stp(sc) - bot\n",
+        "delete 1-5 7\n",
+        "set year 1905 ad\n",
+        "frobnicate\n"
+    };
+
+    if (lexer_input != NULL) {
+        return;
+    }
+
+    size_t size = 1;
+
+    size_t i;
+    for (i = 0; i < LEXER_LINES; i++) {
+        size += strlen(lines[i % ARRSIZE(lines)]);
+    }
+
+    lexer_input = malloc(size);
+
+    char *p = lexer_input;
+    for (i = 0; i < LEXER_LINES; i++) {
+        p = stpcpy(p, lines[i % ARRSIZE(lines)]);
+    }
+}
+
+static void lexer_run()
+{
+    YY_BUFFER_STATE b = yy_scan_string(lexer_input);
+
+    int tok;
+    while ((tok = yylex()) != 0) {
+        if (tok == UNRECOGNIZED) {
+            xfree(yylval.s);
+        }
+    }
+
+    yy_delete_buffer(b);
+}
+
+static void orders_clear()
+{
+    delete_all_orders();
+}
+
+static void register_run()
+{
+    size_t n;
+    for (n = 0; n < NATIONS_N; n++) {
+        enum cd_terr t;
+        for (t = 0; t < TERR_N; t++) {
+            register_order(1u << n, HOLD, t, NO_TERR, NO_TERR,
+                           NO_COAST, false);
+        }
+    }
+}
+
+static void orders_fill()
+{
+    delete_all_orders();
+    register_run();
+}
+
+static void find_run()
+{
+    size_t n;
+    for (n = 0; n < NATIONS_N; n++) {
+        enum cd_terr t;
+        for (t = 0; t < TERR_N; t++) {
+            sink += find_order(1u << n, t);
+        }
+    }
+}
+
+static void delete_run()
+{
+    rangelist_t r = rangelist_cons((struct range){1, NATIONS_N * TERR_N + 1});
+    delete_orders(r);
+    rangelist_free(r);
+}
+
+static void board_setup()
+{
+    board_reset();
+}
+
+static void print_board_run()
+{
+    print_board();
+}
+
+static void list_run()
+{
+    list_all_orders();
+}
+
+static const char *dense_orders[][3] = {
+    {"austria", "vie", "gal"}, {"austria", "bud", "ser"},
+    {"austria", "tri", "alb"}, {"england", "lon", "eng"},
+    {"england", "edi", "nth"}, {"england", "lvp", "yor"},
+    {"france",  "par", "bur"}, {"france",  "mar", "bur"},
+    {"germany", "kie", "den"}, {"germany", "ber", "kie"},
+    {"germany", "mun", "bur"}, {"italy",   "nap", "ion"},
+    {"italy",   "rom", "apu"}, {"italy",   "ven", "tyr"},
+    {"russia",  "mos", "ukr"}, {"russia",  "war", "gal"},
+    {"russia",  "sev", "bla"}, {"turkey",  "ank", "bla"},
+    {"turkey",  "con", "bul"}, {"turkey",  "smy", "arm"},
+};
+
+static void dense_register()
+{
+    delete_all_orders();
+
+    size_t i;
+    for (i = 0; i < ARRSIZE(dense_orders); i++) {
+        enum cd_terr t1 = get_terr(dense_orders[i][1]);
+        enum cd_terr t3 = get_terr(dense_orders[i][2]);
+
+        register_order(get_nation(dense_orders[i][0]), MOVE, t1, t1, t3,
+                       NO_COAST, false);
+    }
+}
+
+static void dense_setup()
+{
+    board_reset();
+    dense_register();
+}
+
+static void adjudicate_run()
+{
+    cache_clear();
+    dense_register();
+    resolve_orders();
+}
+
+static void adjudicate_cached_run()
+{
+    resolve_orders();
+}
+
+static struct bench benches[] = {
+    {"lexer (per line)",        lexer_setup,  lexer_run,
+     LEXER_LINES, 5},
+    {"register_order",          orders_clear, register_run,
+     NATIONS_N * TERR_N, 200},
+    {"find_order",              orders_fill,  find_run,
+     NATIONS_N * TERR_N, 200},
+    {"delete_orders (per order)", orders_fill, delete_run,
+     NATIONS_N * TERR_N, 200},
+    {"print_board",             board_setup,  print_board_run,
+     1, 200},
+    {"list_all_orders",         orders_fill,  list_run,
+     1, 50},
+    {"adjudicate (uncached)",   dense_setup,  adjudicate_run,
+     1, 200},
+    {"adjudicate (cached)",     dense_setup,  adjudicate_cached_run,
+     1, 200},
+};
+
+static void run_bench(FILE *out, struct bench *b)
+{
+    size_t i;
+
+    b->setup();
+    b->run();
+
+    unsigned long warm = 0;
+    size_t warm_allocs = 0;
+    size_t warm_bytes = 0;
+
+    for (i = 0; i < b->iters; i++) {
+        b->setup();
+
+        size_t a0 = allocs, by0 = alloc_bytes;
+        unsigned long t0 = now_ns();
+        b->run();
+        warm += now_ns() - t0;
+
+        warm_allocs += allocs - a0;
+        warm_bytes += alloc_bytes - by0;
+    }
+
+    unsigned long cold = 0;
+    size_t cold_iters = b->iters < 20 ? b->iters : 20;
+
+    for (i = 0; i < cold_iters; i++) {
+        b->setup();
+        scrub_caches();
+
+        unsigned long t0 = now_ns();
+        b->run();
+        cold += now_ns() - t0;
+    }
+
+    double ops = (double)b->ops;
+
+    fprintf(out, "%-28s %12.1f %12.1f %10.2f %12.1f\n",
+            b->name,
+            warm / ops / b->iters,
+            cold / ops / cold_iters,
+            warm_allocs / ops / b->iters,
+            warm_bytes / ops / b->iters);
+}
+
+int main(int argc, char *argv[])
+{
+    int out_fd = dup(STDOUT_FILENO);
+    FILE *out = fdopen(out_fd, "w");
+
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("bench");
+        return 1;
+    }
+
+    scrub_buf = calloc(SCRUB_SIZE, 1);
+
+    board_init();
+    game_init();
+
+    fprintf(out, "%-28s %12s %12s %10s %12s\n",
+            "benchmark", "warm ns/op", "cold ns/op", "allocs/op", "bytes/op");
+
+    size_t i;
+    for (i = 0; i < ARRSIZE(benches); i++) {
+        if (argc > 1 && strstr(benches[i].name, argv[1]) == NULL) {
+            continue;
+        }
+
+        run_bench(out, &benches[i]);
+        fflush(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "alloc.h"
+
+/* Every block is prefixed by its size so frees can be accounted for;
+ * the union keeps the payload as aligned as malloc would */
+union header {
+    size_t size;
+    long double ld;
+    long long ll;
+    void *p;
+};
+
+/* Adjudication runs on a background thread, hence the atomics */
+static atomic_size_t allocs;
+static atomic_size_t frees;
+static atomic_size_t live_bytes;
+static atomic_size_t peak_bytes;
+static atomic_size_t total_bytes;
+
+static void account_alloc(size_t size)
+{
+    atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total_bytes, size, memory_order_relaxed);
+
+    size_t live = atomic_fetch_add_explicit(&live_bytes, size,
+                                            memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&peak_bytes, memory_order_relaxed);
+
+    while (live > peak
+           && !atomic_compare_exchange_weak_explicit(&peak_bytes, &peak, live,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed));
+}
+
+static void account_free(size_t size)
+{
+    atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&live_bytes, size, memory_order_relaxed);
+}
+
+void *xmalloc(size_t size)
+{
+    union header *h = malloc(sizeof *h + size);
+
+    if (h == NULL) {
+        return NULL;
+    }
+
+    h->size = size;
+    account_alloc(size);
+
+    return h + 1;
+}
+
+void *xcalloc(size_t n, size_t size)
+{
+    if (size != 0 && n > ((size_t)-1 - sizeof(union header)) / size) {
+        return NULL;
+    }
+
+    void *p = xmalloc(n * size);
+
+    if (p != NULL) {
+        memset(p, 0, n * size);
+    }
+
+    return p;
+}
+
+void *xrealloc(void *p, size_t size)
+{
+    if (p == NULL) {
+        return xmalloc(size);
+    }
+
+    union header *h = (union header *)p - 1;
+    size_t old_size = h->size;
+
+    h = realloc(h, sizeof *h + size);
+
+    if (h == NULL) {
+        return NULL;
+    }
+
+    account_free(old_size);
+    account_alloc(size);
+    h->size = size;
+
+    return h + 1;
+}
+
+char *xstrdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *d = xmalloc(len);
+
+    if (d != NULL) {
+        memcpy(d, s, len);
+    }
+
+    return d;
+}
+
+void xfree(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+
+    union header *h = (union header *)p - 1;
+    account_free(h->size);
+
+    free(h);
+}
+
+size_t alloc_live()
+{
+    return atomic_load(&allocs) - atomic_load(&frees);
+}
+
+void print_alloc_stats()
+{
+    printf("Allocations: %zu live (%zu bytes), %zu total (%zu bytes), "
+           "peak %zu bytes\n",
+           alloc_live(), atomic_load(&live_bytes),
+           atomic_load(&allocs), atomic_load(&total_bytes),
+           atomic_load(&peak_bytes));
+}
@@ -0,0 +1,38 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include <stddef.h>
+
+/* Counting allocator for everything the program itself owns. Memory
+ * obtained with these must be released with xfree, never free, and
+ * vice versa (e.g. lines returned by readline) */
+
+void *xmalloc(size_t size);
+void *xcalloc(size_t n, size_t size);
+void *xrealloc(void *p, size_t size);
+char *xstrdup(const char *s);
+void xfree(void *p);
+
+size_t alloc_live();
+void print_alloc_stats();
+
+#endif /* _ALLOC_H_ */
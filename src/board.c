@@ -18,6 +18,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -128,6 +129,57 @@ const char *get_unit_name(enum cd_unit unit)
     }
 }
 
+static bool changed[TERR_N];
+static bool autodiff = false;
+
+/* Rendered board lines, len == 0 until first printed after a change */
+static struct {
+    int len;
+    char text[128];
+} lines[TERR_N];
+
+void touch_terr(enum cd_terr t)
+{
+    changed[t] = true;
+    lines[t].len = 0;
+}
+
+static void render_terr(enum cd_terr t)
+{
+    struct terr_info *ti = &board[t];
+    char buf[64];
+
+    if (ti->occupier == NO_NATION) {
+        sprintf(buf, "%s: Not occupied", get_terr_name(t));
+    } else {
+        sprintf(buf, "%s: %s%s %s", get_terr_name(t),
+                                    get_unit_name(ti->unit),
+                                    get_coast_name(ti->coast),
+                                    get_nation_name(ti->occupier));
+    }
+
+    char *text = lines[t].text;
+    int len = sprintf(text, "%*s", -COL_WIDTH, buf);
+
+    if (ti->supp_center) {
+        len += sprintf(text + len, " (%s)", ti->owner != NO_NATION
+                                          ? get_nation_name(ti->owner)
+                                          : "independent");
+    }
+
+    text[len++] = '\n';
+    lines[t].len = len;
+}
+
+static void print_terr(enum cd_terr t)
+{
+    if (lines[t].len == 0) {
+        render_terr(t);
+    }
+
+    pputs(lines[t].text, lines[t].len);
+}
+
 void print_board()
 {
     pprintf_init();
@@ -139,29 +191,46 @@ void print_board()
             continue;
         }
 
-        char buf[128];
+        print_terr(t);
+    }
+}
 
-        if (ti->occupier == NO_NATION) {
-            sprintf(buf, "%s: Not occupied", get_terr_name(t));
-        } else {
-            sprintf(buf, "%s: %s%s %s", get_terr_name(t),
-                                        get_unit_name(ti->unit),
-                                        get_coast_name(ti->coast),
-                                        get_nation_name(ti->occupier));
-        }
+void print_board_diff()
+{
+    pprintf_init();
 
-        pprintf("%*s", -COL_WIDTH, buf);
+    bool any = false;
 
-        if (ti->supp_center) {
-            pprintf(" (%s)", ti->owner != NO_NATION
-                           ? get_nation_name(ti->owner)
-                           : "independent");
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (changed[t]) {
+            print_terr(t);
+            any = true;
         }
+    }
 
-        pputchar('\n');
+    if (!any) {
+        pprintf("No changes\n");
     }
 }
 
+void board_diff_begin()
+{
+    memset(changed, 0, sizeof changed);
+}
+
+void board_diff_end()
+{
+    if (autodiff) {
+        print_board_diff();
+    }
+}
+
+void set_autodiff(bool on)
+{
+    autodiff = on;
+}
+
 void board_init()
 {
     enum cd_terr centers[] = {
@@ -237,6 +306,7 @@ void set_terrs(tclist_t tclist, enum cd_unit unit, enum cd_nation nation)
         board[t].occupier = nation;
         board[t].unit = unit;
         board[t].coast = coast;
+        touch_terr(t);
     }
 }
 
@@ -247,6 +317,7 @@ void set_centers(terrlist_t tlist, enum cd_nation nation)
     while (tlist != NULL) {
         if (board[tlist->item].supp_center) {
             board[tlist->item].owner = nation;
+            touch_terr(tlist->item);
         } else {
             pprintf("%s: not a supply center\n", tlist->item);
         }
@@ -260,6 +331,7 @@ void clear_terrs(terrlist_t tlist)
     while (tlist != NULL) {
         board[tlist->item].occupier = NO_NATION;
         cd_clear_unit(tlist->item);
+        touch_terr(tlist->item);
         LIST_ADVANCE(tlist);
     }
 }
@@ -271,6 +343,7 @@ void clear_centers(terrlist_t tlist)
     while (tlist != NULL) {
         if (board[tlist->item].supp_center) {
             board[tlist->item].owner = NO_NATION;
+            touch_terr(tlist->item);
         } else {
             pprintf("%s: not a supply center\n", tlist->item);
         }
@@ -285,6 +358,7 @@ void remove_all_units(enum cd_nation nat)
     for (t = 0; t < TERR_N; t++) {
         if (board[t].occupier == nat) {
             board[t].occupier = NO_NATION;
+            touch_terr(t);
         }
     }
 }
@@ -295,6 +369,7 @@ void clear_all()
     for (t = 0; t < TERR_N; t++) {
         board[t].occupier = NO_NATION;
         board[t].owner = NO_NATION;
+        touch_terr(t);
 
         cd_clear_unit(t);
     }
@@ -305,9 +380,11 @@ void update_centers()
     enum cd_terr t;
     for (t = 0; t < TERR_N; t++) {
         if (board[t].supp_center
-            && board[t].occupier != NO_NATION) {
+            && board[t].occupier != NO_NATION
+            && board[t].owner != board[t].occupier) {
 
             board[t].owner = board[t].occupier;
+            touch_terr(t);
         }
     }
 }
@@ -45,10 +45,16 @@ extern struct terr_info board[TERR_N];
 
 extern enum cd_terr home_centers[][5];
 
-unsigned units[NATIONS_N];
-unsigned centers[NATIONS_N];
+extern unsigned units[NATIONS_N];
+extern unsigned centers[NATIONS_N];
 
 void print_board();
+void print_board_diff();
+
+void touch_terr(enum cd_terr t);
+void board_diff_begin();
+void board_diff_end();
+void set_autodiff(bool on);
 
 int get_terr(const char *name);
 unsigned get_nation(const char *name);
@@ -0,0 +1,145 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "alloc.h"
+
+struct cache_entry {
+    uint64_t hash;
+    unsigned long last_used;
+
+    void *key;
+    size_t key_size;
+    void *value;
+    size_t value_size;
+};
+
+static struct cache_entry entries[CACHE_SIZE];
+static unsigned long clock_hand = 0;
+
+size_t cache_hits = 0;
+size_t cache_misses = 0;
+
+uint64_t hash_bytes(const void *data, size_t size)
+{
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ull;
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+const void *cache_lookup(const void *key, size_t key_size, size_t *value_size)
+{
+    uint64_t h = hash_bytes(key, key_size);
+
+    size_t i;
+    for (i = 0; i < CACHE_SIZE; i++) {
+        struct cache_entry *e = &entries[i];
+
+        if (e->key != NULL
+            && e->hash == h
+            && e->key_size == key_size
+            && memcmp(e->key, key, key_size) == 0) {
+
+            e->last_used = ++clock_hand;
+            cache_hits++;
+
+            *value_size = e->value_size;
+            return e->value;
+        }
+    }
+
+    cache_misses++;
+
+    return NULL;
+}
+
+void cache_insert(const void *key, size_t key_size,
+                  const void *value, size_t value_size)
+{
+    struct cache_entry *victim = &entries[0];
+
+    size_t i;
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (entries[i].key == NULL) {
+            victim = &entries[i];
+            break;
+        }
+
+        if (entries[i].last_used < victim->last_used) {
+            victim = &entries[i];
+        }
+    }
+
+    xfree(victim->key);
+    xfree(victim->value);
+
+    victim->hash = hash_bytes(key, key_size);
+    victim->last_used = ++clock_hand;
+
+    victim->key = xmalloc(key_size);
+    memcpy(victim->key, key, key_size);
+    victim->key_size = key_size;
+
+    victim->value = xmalloc(value_size);
+    memcpy(victim->value, value, value_size);
+    victim->value_size = value_size;
+}
+
+size_t cache_entries()
+{
+    size_t n = 0;
+
+    size_t i;
+    for (i = 0; i < CACHE_SIZE; i++) {
+        if (entries[i].key != NULL) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+void cache_clear()
+{
+    size_t i;
+    for (i = 0; i < CACHE_SIZE; i++) {
+        xfree(entries[i].key);
+        xfree(entries[i].value);
+    }
+
+    memset(entries, 0, sizeof entries);
+}
+
+void print_cache_stats()
+{
+    printf("Adjudication cache: %zu hits, %zu misses, %zu/%d entries\n",
+           cache_hits, cache_misses, cache_entries(), CACHE_SIZE);
+}
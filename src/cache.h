@@ -0,0 +1,41 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_SIZE 64
+
+extern size_t cache_hits;
+extern size_t cache_misses;
+
+const void *cache_lookup(const void *key, size_t key_size, size_t *value_size);
+void cache_insert(const void *key, size_t key_size,
+                  const void *value, size_t value_size);
+size_t cache_entries();
+void cache_clear();
+
+void print_cache_stats();
+
+uint64_t hash_bytes(const void *data, size_t size);
+
+#endif /* _CACHE_H_ */
@@ -25,6 +25,7 @@
 #include <limits.h>
 
 #include "list.h"
+#include "alloc.h"
 
 #define PROMPT "> "
 #define COL_WIDTH 18
@@ -63,11 +64,11 @@ do {                     \
     b = _tmp;            \
 } while (0)
 
-#define GROW_VEC(v, s)             \
-do {                               \
-    s *= 3;                        \
-    s /= 2;                        \
-    v = realloc(v, s * sizeof *v); \
+#define GROW_VEC(v, s)              \
+do {                                \
+    s *= 3;                         \
+    s /= 2;                         \
+    v = xrealloc(v, s * sizeof *v); \
 } while (0)
 
 #define UNIQ(a, n)                    \
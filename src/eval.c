@@ -0,0 +1,158 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "board.h"
+#include "map.h"
+#include "eval.h"
+
+#define NEIGHBOURS_MAX 16
+
+#define W_CENTER 16
+#define W_THREAT 2
+#define W_EXPOSED 3
+
+static enum cd_terr centers_list[TERR_N];
+static size_t centers_list_n;
+
+/* Territories any unit could reach from t, whatever the coast */
+static enum cd_terr neighbours[TERR_N][NEIGHBOURS_MAX];
+static size_t neighbours_n[TERR_N];
+
+static void add_neighbour(enum cd_terr t, enum cd_terr to)
+{
+    size_t i;
+    for (i = 0; i < neighbours_n[t]; i++) {
+        if (neighbours[t][i] == to) {
+            return;
+        }
+    }
+
+    neighbours[t][neighbours_n[t]++] = to;
+}
+
+void eval_init()
+{
+    static bool done = false;
+
+    if (done) {
+        return;
+    }
+
+    map_init();
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (board[t].supp_center) {
+            centers_list[centers_list_n++] = t;
+        }
+
+        size_t i, c;
+        for (i = 0; i < army_adj[t].n; i++) {
+            add_neighbour(t, army_adj[t].to[i].terr);
+        }
+
+        for (c = 0; c < 3; c++) {
+            for (i = 0; i < fleet_adj[t][c].n; i++) {
+                add_neighbour(t, fleet_adj[t][c].to[i].terr);
+            }
+        }
+    }
+
+    done = true;
+}
+
+void eval_clear(struct eval_batch *b)
+{
+    b->n = 0;
+}
+
+size_t eval_add(struct eval_batch *b, const struct terr_info position[])
+{
+    size_t i = b->n++;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        const struct terr_info *ti = &position[t];
+
+        b->occupier[t][i] = ti->occupier == NO_NATION
+                          ? 0 : trail0s(ti->occupier) + 1;
+        b->owner[t][i] = ti->owner == NO_NATION
+                       ? 0 : trail0s(ti->owner) + 1;
+    }
+
+    return i;
+}
+
+/* Scores every position of the batch for every nation: supply centers
+ * owned, units next to centers owned by somebody else, and home centers
+ * left empty next to a foreign unit. Each term is a branchless pass over
+ * the batch for one territory, which the compiler can vectorize */
+void eval_run(const struct eval_batch *b, int16_t scores[][EVAL_BATCH])
+{
+    size_t n = b->n;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        const uint8_t k = nat_i + 1;
+        int16_t *s = scores[nat_i];
+
+        memset(s, 0, n * sizeof s[0]);
+
+        size_t c;
+        for (c = 0; c < centers_list_n; c++) {
+            enum cd_terr t = centers_list[c];
+            const uint8_t *owner = b->owner[t];
+
+            size_t i;
+            for (i = 0; i < n; i++) {
+                s[i] += (owner[i] == k) * W_CENTER;
+            }
+
+            size_t j;
+            for (j = 0; j < neighbours_n[t]; j++) {
+                const uint8_t *near = b->occupier[neighbours[t][j]];
+
+                for (i = 0; i < n; i++) {
+                    s[i] += ((near[i] == k) & (owner[i] != k)) * W_THREAT;
+                }
+            }
+        }
+
+        for (c = 0; home_centers[nat_i][c] != NO_TERR; c++) {
+            enum cd_terr t = home_centers[nat_i][c];
+            const uint8_t *here = b->occupier[t];
+
+            size_t j;
+            for (j = 0; j < neighbours_n[t]; j++) {
+                const uint8_t *near = b->occupier[neighbours[t][j]];
+
+                size_t i;
+                for (i = 0; i < n; i++) {
+                    s[i] -= ((near[i] != 0) & (near[i] != k) & (here[i] != k))
+                          * W_EXPOSED;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EVAL_H_
+#define _EVAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cdippy.h>
+
+#include "board.h"
+
+#define EVAL_BATCH 256
+
+/* Positions are packed struct-of-arrays, one byte per territory and
+ * position, holding the nation index plus one (0 when empty or
+ * unowned), so that scoring loops run across the whole batch */
+struct eval_batch {
+    size_t n;
+    uint8_t occupier[TERR_N][EVAL_BATCH];
+    uint8_t owner[TERR_N][EVAL_BATCH];
+};
+
+void eval_init();
+void eval_clear(struct eval_batch *b);
+size_t eval_add(struct eval_batch *b, const struct terr_info position[]);
+void eval_run(const struct eval_batch *b, int16_t scores[][EVAL_BATCH]);
+
+#endif /* _EVAL_H_ */
@@ -0,0 +1,463 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "pprintf.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "workers.h"
+#include "explain.h"
+
+#define CANDIDATES_MAX 24
+#define FOUND_MAX 8
+
+/* Position and orders of the last adjudicated main phase, numbered the
+ * way 'list' numbered them */
+static struct {
+    bool valid;
+    struct terr_info board[TERR_N];
+    size_t n;
+    struct order orders[NATIONS_N * TERR_N];
+    enum cd_nation nations[NATIONS_N * TERR_N];
+    enum outcome outcomes[NATIONS_N * TERR_N];
+} last;
+
+struct edit {
+    size_t unit;
+    struct order o;
+};
+
+struct found {
+    size_t n;
+    struct edit edits[FOUND_MAX][2];
+};
+
+struct explain_job {
+    size_t failed;
+    size_t units_n;
+    enum cd_terr units[TERR_N];
+    struct order current[TERR_N];
+
+    size_t editable_n;
+    size_t editable[TERR_N];
+    size_t candidates_n[TERR_N];
+    struct order candidates[TERR_N][CANDIDATES_MAX];
+
+    size_t slots_n;
+    struct edit slots[TERR_N * CANDIDATES_MAX];
+    size_t depth;
+
+    struct found found;
+};
+
+void explain_remember(const struct order orders[][TERR_N],
+                      const size_t orders_n[],
+                      const enum outcome outcomes[][TERR_N])
+{
+    memcpy(last.board, board, sizeof board);
+    last.n = 0;
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            last.orders[last.n] = orders[nat_i][i];
+            last.nations[last.n] = 1u << nat_i;
+            last.outcomes[last.n] = outcomes[nat_i][i];
+            last.n++;
+        }
+    }
+
+    last.valid = true;
+}
+
+/* Speculatively adjudicates the position with orders[] in place of the
+ * last ones, registering only the cluster of the failed order: nothing
+ * outside it can change its outcome */
+static bool succeeds(const struct explain_job *job, const struct order orders[])
+{
+    enum cd_terr parent[TERR_N];
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        parent[t] = t;
+    }
+
+    size_t i;
+    for (i = 0; i < job->units_n; i++) {
+        join_order(parent, &orders[i]);
+    }
+
+    const struct order *failed = &orders[job->failed];
+    enum cd_terr root = find_root(parent, failed->t1);
+
+    size_t j = 0, failed_j = 0;
+
+    for (i = 0; i < job->units_n; i++) {
+        const struct order *o = &orders[i];
+
+        if (find_root(parent, o->t1) != root) {
+            continue;
+        }
+
+        if (i == job->failed) {
+            failed_j = j;
+        }
+
+        if (register_order_with_adjudicator(o)) {
+            j++;
+        }
+    }
+
+    cd_run_adjudicator();
+
+    if (failed->kind == HOLD) {
+        for (i = 0; i < cd_retreats_n; i++) {
+            if (cd_retreats[i].who == failed->t1) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return cd_resolutions[failed_j] == SUCCEEDS;
+}
+
+static bool try_edits(const struct explain_job *job, struct order orders[],
+                      const struct edit *a, const struct edit *b)
+{
+    orders[a->unit] = a->o;
+    if (b != NULL) {
+        orders[b->unit] = b->o;
+    }
+
+    bool ret = succeeds(job, orders);
+
+    orders[a->unit] = job->current[a->unit];
+    if (b != NULL) {
+        orders[b->unit] = job->current[b->unit];
+    }
+
+    return ret;
+}
+
+/* Edit sets are dealt to the workers round robin: single edits, or pairs
+ * of edits to two different units */
+static void explain_work(size_t w, size_t n, int fd, void *data)
+{
+    const struct explain_job *job = data;
+    struct found found;
+    found.n = 0;
+
+    register_units_with_adjudicator(last.board);
+
+    struct order orders[TERR_N];
+    memcpy(orders, job->current, job->units_n * sizeof orders[0]);
+
+    size_t k = 0;
+
+    size_t i, j;
+    for (i = 0; i < job->slots_n && found.n < FOUND_MAX; i++) {
+        const struct edit *a = &job->slots[i];
+
+        if (job->depth == 1) {
+            if (k++ % n == w && try_edits(job, orders, a, NULL)) {
+                found.edits[found.n][0] = *a;
+                found.n++;
+            }
+
+            continue;
+        }
+
+        for (j = i + 1; j < job->slots_n && found.n < FOUND_MAX; j++) {
+            const struct edit *b = &job->slots[j];
+
+            if (b->unit == a->unit || k++ % n != w) {
+                continue;
+            }
+
+            if (try_edits(job, orders, a, b)) {
+                found.edits[found.n][0] = *a;
+                found.edits[found.n][1] = *b;
+                found.n++;
+            }
+        }
+    }
+
+    write_full(fd, &found, sizeof found);
+}
+
+static bool explain_collect(size_t w, int fd, void *data)
+{
+    (void)w;
+
+    struct explain_job *job = data;
+    struct found found;
+
+    if (!read_full(fd, &found, sizeof found)) {
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; i < found.n && job->found.n < FOUND_MAX; i++) {
+        memcpy(job->found.edits[job->found.n++], found.edits[i],
+               sizeof found.edits[i]);
+    }
+
+    return true;
+}
+
+static bool same_order(const struct order *a, const struct order *b)
+{
+    return a->kind == b->kind && a->t1 == b->t1 && a->t2 == b->t2
+           && a->t3 == b->t3 && a->coast == b->coast;
+}
+
+static void add_candidate(struct explain_job *job, size_t e,
+                          const struct order *o)
+{
+    size_t u = job->editable[e];
+
+    if (job->candidates_n[e] >= CANDIDATES_MAX
+        || same_order(o, &job->current[u])) {
+        return;
+    }
+
+    job->candidates[e][job->candidates_n[e]++] = *o;
+}
+
+/* Other units can help by holding, by supporting the failed order, or by
+ * moving: to cut a support, to vacate a square or to attack */
+static void build_candidates(struct explain_job *job, size_t e)
+{
+    enum cd_terr t = job->units[job->editable[e]];
+    const struct terr_info *ti = &last.board[t];
+    const struct order *failed = &job->current[job->failed];
+
+    struct order o = {HOLD, t, NO_TERR, {NO_TERR}, NO_COAST, false};
+    add_candidate(job, e, &o);
+
+    if (failed->kind == MOVE
+        && map_adjacent(t, ti->unit, ti->coast, failed->t3)) {
+
+        o.kind = SUPM;
+        o.t2 = failed->t2;
+        o.t3 = failed->t3;
+        add_candidate(job, e, &o);
+    } else if (failed->kind != MOVE
+               && map_adjacent(t, ti->unit, ti->coast, failed->t1)) {
+
+        o.kind = SUPH;
+        o.t2 = failed->t1;
+        o.t3 = NO_TERR;
+        add_candidate(job, e, &o);
+    }
+
+    const struct adjacency *adj = map_adjacency(t, ti->unit, ti->coast);
+
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        o.kind = MOVE;
+        o.t2 = t;
+        o.t3 = adj->to[i].terr;
+        o.coast = ti->unit == FLEET ? adj->to[i].coast : NO_COAST;
+        add_candidate(job, e, &o);
+    }
+}
+
+/* Units worth editing sit in the failed order's cluster or next to one of
+ * the territories it names */
+static void find_editable(struct explain_job *job)
+{
+    enum cd_terr parent[TERR_N];
+    bool near[TERR_N];
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        parent[t] = t;
+        near[t] = false;
+    }
+
+    size_t i;
+    for (i = 0; i < job->units_n; i++) {
+        join_order(parent, &job->current[i]);
+    }
+
+    const struct order *failed = &job->current[job->failed];
+    enum cd_terr named[] = {failed->t1, failed->t2, failed->t3};
+
+    for (i = 0; i < ARRSIZE(named); i++) {
+        if (named[i] == NO_TERR) {
+            continue;
+        }
+
+        const struct adjacency *adj = &army_adj[named[i]];
+        size_t k;
+        for (k = 0; k < adj->n; k++) {
+            near[adj->to[k].terr] = true;
+        }
+
+        size_t c;
+        for (c = 0; c < 3; c++) {
+            adj = &fleet_adj[named[i]][c];
+            for (k = 0; k < adj->n; k++) {
+                near[adj->to[k].terr] = true;
+            }
+        }
+    }
+
+    enum cd_terr root = find_root(parent, failed->t1);
+
+    job->editable_n = 0;
+
+    for (i = 0; i < job->units_n; i++) {
+        t = job->units[i];
+
+        if (i != job->failed
+            && (near[t] || find_root(parent, t) == root)) {
+            job->editable[job->editable_n] = i;
+            job->candidates_n[job->editable_n] = 0;
+            build_candidates(job, job->editable_n);
+            job->editable_n++;
+        }
+    }
+}
+
+static void list_slots(struct explain_job *job)
+{
+    job->slots_n = 0;
+
+    size_t e, i;
+    for (e = 0; e < job->editable_n; e++) {
+        for (i = 0; i < job->candidates_n[e]; i++) {
+            struct edit *s = &job->slots[job->slots_n++];
+
+            s->unit = job->editable[e];
+            s->o = job->candidates[e][i];
+        }
+    }
+}
+
+static void print_explanation(const struct explain_job *job, unsigned n)
+{
+    pprintf_init();
+
+    pprintf("\nOrder %u (", n);
+    pprint_order((struct order *)&job->current[job->failed]);
+    pprintf(")");
+
+    if (job->found.n == 0) {
+        pprintf(" cannot succeed by changing one or two nearby orders\n\n");
+        return;
+    }
+
+    pprintf(" would have succeeded with:\n");
+
+    size_t i, j;
+    for (i = 0; i < job->found.n; i++) {
+        for (j = 0; j < job->depth; j++) {
+            const struct edit *e = &job->found.edits[i][j];
+
+            pprintf("%s%s: ", j == 0 ? "  " : "  and ",
+                    get_nation_name(last.board[job->units[e->unit]].occupier));
+            pprint_order((struct order *)&e->o);
+            pprintf(" instead of ");
+            pprint_order((struct order *)&job->current[e->unit]);
+            pputchar('\n');
+        }
+    }
+
+    pputchar('\n');
+}
+
+void explain_fail(unsigned n)
+{
+    if (!last.valid) {
+        puts("No orders adjudicated yet");
+        return;
+    }
+
+    if (n == 0 || n > last.n) {
+        printf("No such order: %u\n", n);
+        return;
+    }
+
+    if (last.outcomes[n - 1] != FAILURE) {
+        printf("Order %u did not fail\n", n);
+        return;
+    }
+
+    map_init();
+
+    static struct explain_job job;
+
+    job.units_n = 0;
+    job.found.n = 0;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (last.board[t].occupier == NO_NATION) {
+            continue;
+        }
+
+        struct order hold = {HOLD, t, NO_TERR, {NO_TERR}, NO_COAST, false};
+
+        job.units[job.units_n] = t;
+        job.current[job.units_n] = hold;
+
+        size_t i;
+        for (i = 0; i < last.n; i++) {
+            if (last.orders[i].t1 == t && last.nations[i] == last.board[t].occupier
+                && last.outcomes[i] != IGNORED) {
+                job.current[job.units_n] = last.orders[i];
+            }
+        }
+
+        if (last.orders[n - 1].t1 == t) {
+            job.failed = job.units_n;
+        }
+
+        job.units_n++;
+    }
+
+    find_editable(&job);
+    list_slots(&job);
+
+    size_t workers = workers_n() < job.slots_n ? workers_n() : job.slots_n;
+
+    for (job.depth = 1; job.depth <= 2; job.depth++) {
+        if (workers > 0
+            && !run_workers(workers, explain_work, explain_collect, &job)) {
+            puts("Search failed");
+            return;
+        }
+
+        if (job.found.n > 0) {
+            break;
+        }
+    }
+
+    print_explanation(&job, n);
+}
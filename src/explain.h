@@ -0,0 +1,34 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EXPLAIN_H_
+#define _EXPLAIN_H_
+
+#include <stddef.h>
+
+#include <cdippy.h>
+
+#include "game.h"
+
+void explain_remember(const struct order orders[][TERR_N],
+                      const size_t orders_n[],
+                      const enum outcome outcomes[][TERR_N]);
+void explain_fail(unsigned n);
+
+#endif /* _EXPLAIN_H_ */
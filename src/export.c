@@ -0,0 +1,296 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/stat.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "export.h"
+
+#define NAME_MAX_LEN 24
+#define SUPP_CENTERS_N 34
+#define COLUMNS_N (2 + 4 * NATIONS_N + SUPP_CENTERS_N)
+
+struct column {
+    char name[NAME_MAX_LEN];
+    uint8_t width;
+    bool is_signed;
+    FILE *f;
+};
+
+static char *export_path = NULL;
+
+static struct column columns[COLUMNS_N];
+static size_t columns_n = 0;
+
+static size_t rows = 0;
+
+static enum cd_terr supp_centers[SUPP_CENTERS_N];
+static unsigned dislodged_n[NATIONS_N];
+
+static void add_column(const char *prefix, const char *suffix,
+                       uint8_t width, bool is_signed)
+{
+    struct column *c = &columns[columns_n++];
+
+    snprintf(c->name, sizeof c->name, "%s%s%s",
+             prefix, suffix ? "." : "", suffix ? suffix : "");
+
+    c->width = width;
+    c->is_signed = is_signed;
+    c->f = NULL;
+}
+
+static FILE *open_in_dir(const char *name)
+{
+    char *file = xmalloc(strlen(export_path) + strlen(name) + 2);
+    sprintf(file, "%s/%s", export_path, name);
+
+    FILE *f = fopen(file, "wb");
+    if (f == NULL) {
+        perror(file);
+    }
+
+    xfree(file);
+    return f;
+}
+
+struct column_entry {
+    char name[NAME_MAX_LEN];
+    uint8_t width;
+    uint8_t is_signed;
+    uint8_t pad[6];
+};
+
+static bool write_manifest()
+{
+    FILE *f = open_in_dir(EXPORT_MANIFEST);
+    if (f == NULL) {
+        return false;
+    }
+
+    char magic[8] = EXPORT_MAGIC;
+    uint32_t n = columns_n;
+
+    bool ok = fwrite(magic, sizeof magic, 1, f) == 1
+              && fwrite(&n, sizeof n, 1, f) == 1;
+
+    size_t i;
+    for (i = 0; ok && i < columns_n; i++) {
+        struct column_entry e;
+
+        memset(&e, 0, sizeof e);
+        memcpy(e.name, columns[i].name, sizeof e.name);
+        e.width = columns[i].width;
+        e.is_signed = columns[i].is_signed;
+
+        ok = fwrite(&e, sizeof e, 1, f) == 1;
+    }
+
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        perror(EXPORT_MANIFEST);
+    }
+
+    return ok;
+}
+
+static void close_columns()
+{
+    size_t i;
+    for (i = 0; i < columns_n; i++) {
+        if (columns[i].f != NULL) {
+            fclose(columns[i].f);
+            columns[i].f = NULL;
+        }
+    }
+
+    xfree(export_path);
+    export_path = NULL;
+}
+
+int export_init(const char *path)
+{
+    export_path = xstrdup(path);
+
+    add_column("year", NULL, sizeof (int16_t), true);
+    add_column("season", NULL, sizeof (uint8_t), false);
+
+    static const char *per_nation[] = {
+        "centers", "units", "dislodged", "builds"
+    };
+
+    size_t i, j;
+    for (i = 0; i < ARRSIZE(per_nation); i++) {
+        for (j = 0; j < NATIONS_N; j++) {
+            add_column(per_nation[i], get_nation_name(1u << j),
+                       sizeof (uint8_t), false);
+        }
+    }
+
+    /* Owners as nation index + 1, 0 for neutral */
+    enum cd_terr t;
+    for (t = 0, i = 0; t < TERR_N && i < SUPP_CENTERS_N; t++) {
+        if (board[t].supp_center) {
+            supp_centers[i++] = t;
+            add_column("owner", get_terr_name(t), sizeof (uint8_t), false);
+        }
+    }
+
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        perror(path);
+        close_columns();
+        return -1;
+    }
+
+    if (!write_manifest()) {
+        close_columns();
+        return -1;
+    }
+
+    for (i = 0; i < columns_n; i++) {
+        columns[i].f = open_in_dir(columns[i].name);
+
+        if (columns[i].f == NULL) {
+            close_columns();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Credits every unit about to retreat to its nation */
+void export_dislodged()
+{
+    if (export_path == NULL) {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < cd_retreats_n; i++) {
+        enum cd_nation nat = board[cd_retreats[i].who].occupier;
+
+        if (nat != NO_NATION) {
+            dislodged_n[trail0s(nat)]++;
+        }
+    }
+}
+
+static void put(struct column *c, long value)
+{
+    if (c->width == sizeof (int16_t)) {
+        int16_t v = value;
+        fwrite(&v, sizeof v, 1, c->f);
+    } else {
+        uint8_t v = value;
+        fwrite(&v, sizeof v, 1, c->f);
+    }
+}
+
+/* Appends the row to every column and flushes it, so that an export
+ * cut short by a crash still holds every phase before the last */
+void export_phase(int year, enum season season, const unsigned builds[])
+{
+    if (export_path == NULL) {
+        return;
+    }
+
+    count_units();
+    count_centers();
+
+    struct column *c = columns;
+
+    put(c++, year);
+    put(c++, season);
+
+    size_t i;
+    for (i = 0; i < NATIONS_N; i++) {
+        put(c++, centers[i]);
+    }
+
+    for (i = 0; i < NATIONS_N; i++) {
+        put(c++, units[i]);
+    }
+
+    for (i = 0; i < NATIONS_N; i++) {
+        put(c++, dislodged_n[i]);
+        dislodged_n[i] = 0;
+    }
+
+    for (i = 0; i < NATIONS_N; i++) {
+        put(c++, builds ? builds[i] : 0);
+    }
+
+    for (i = 0; i < SUPP_CENTERS_N; i++) {
+        enum cd_nation owner = board[supp_centers[i]].owner;
+        put(c++, owner == NO_NATION ? 0 : trail0s(owner) + 1);
+    }
+
+    for (i = 0; i < columns_n; i++) {
+        if (fflush(columns[i].f) != 0 || ferror(columns[i].f)) {
+            perror(export_path);
+            printf("Export stopped after %zu phases\n", rows);
+            close_columns();
+            return;
+        }
+    }
+
+    rows++;
+}
+
+/* Closes the columns; nothing to do unless export_init was called */
+int export_close()
+{
+    if (export_path == NULL) {
+        return 0;
+    }
+
+    bool ok = true;
+
+    size_t i;
+    for (i = 0; i < columns_n; i++) {
+        if (fclose(columns[i].f) != 0) {
+            ok = false;
+        }
+
+        columns[i].f = NULL;
+    }
+
+    if (ok) {
+        printf("Exported %zu phases to %s\n", rows, export_path);
+    } else {
+        perror(export_path);
+    }
+
+    xfree(export_path);
+    export_path = NULL;
+
+    return ok ? 0 : -1;
+}
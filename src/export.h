@@ -0,0 +1,51 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _EXPORT_H_
+#define _EXPORT_H_
+
+#include "game.h"
+
+/* Columnar per-phase statistics, one row per completed movement phase,
+ * appended as each phase is committed. The export is a directory with
+ * one file per column, holding its fixed-width values in native byte
+ * order, e.g. "centers.France", and a manifest:
+ *
+ *   char     magic[8]          "CDPCOL2"
+ *   uint32_t columns
+ *   columns x {
+ *       char     name[24]      NUL-padded, also the column's file name
+ *       uint8_t  width         bytes per value
+ *       uint8_t  is_signed
+ *       uint8_t  pad[6]
+ *   }
+ *
+ * The number of rows is the size of a column file over its width; a
+ * process killed while writing a row can leave some columns one row
+ * longer than the others. */
+
+#define EXPORT_MAGIC "CDPCOL2"
+#define EXPORT_MANIFEST "columns"
+
+int export_init(const char *path);
+void export_dislodged();
+void export_phase(int year, enum season season, const unsigned builds[]);
+int export_close();
+
+#endif /* _EXPORT_H_ */
@@ -21,7 +21,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
+#include <pthread.h>
 #include <readline/readline.h>
 
 #include "commons.h"
@@ -29,6 +31,20 @@
 #include "pprintf.h"
 #include "board.h"
 #include "game.h"
+#include "sched.h"
+#include "submit.h"
+#include "cache.h"
+#include "stats.h"
+#include "probes.h"
+#include "export.h"
+#include "explain.h"
+#include "map.h"
+#include "targets.h"
+#include "spectate.h"
+
+#define ADJUDICATION_GRACE_MS 50
+#define ALL_CLUSTERS (-1)
+#define SELECTED_CLUSTERS (-2)
 
 #define VALIDATE_CUR_NAT()             \
 do {                                   \
@@ -65,9 +81,36 @@ enum game_state {
 
 enum game_state state = DEFAULT;
 
+/* A process hosts a single game, so there is a single deadline timer;
+ * a server keeps one process per game rather than one wheel for all */
+static unsigned deadlines[ARRSIZE(state_names)];
+static struct timer deadline_timer;
+
+/* Set when the phase being adjudicated was closed by its deadline, so
+ * nobody is around to answer the disband prompt */
+static bool deadline_passed = false;
+
+/* Cleared when commands come from a watched file rather than a user */
+static bool interactive = true;
+
+void arm_deadline()
+{
+    if (deadlines[state] == 0) {
+        timer_disarm(&deadline_timer);
+        return;
+    }
+
+    timer_arm(&deadline_timer, deadlines[state] * 1000ul);
+}
+
 void set_state(enum game_state new_state)
 {
     state = new_state;
+    deadline_passed = false;
+
+    submit_next_phase();
+
+    arm_deadline();
 
     switch (state) {
     case DEFAULT:
@@ -106,6 +149,33 @@ static size_t orders_n[NATIONS_N];
 
 static unsigned to_build[NATIONS_N];
 
+/* Rendered order text, kept parallel to orders and moved along with them */
+static struct order_line {
+    int len;
+    char text[64];
+} order_lines[NATIONS_N][TERR_N];
+
+static bool dirty_terrs[TERR_N];
+static bool all_dirty = true;
+
+static bool verify_incremental = false;
+
+size_t resolved_incrementally = 0;
+size_t verify_mismatches = 0;
+
+void touch_order(const struct order *o)
+{
+    dirty_terrs[o->t1] = true;
+
+    if (o->t2 != NO_TERR) {
+        dirty_terrs[o->t2] = true;
+    }
+
+    if (o->t3 != NO_TERR) {
+        dirty_terrs[o->t3] = true;
+    }
+}
+
 void print_build_digest()
 {
     puts("Some nations can build new units:");
@@ -128,10 +198,16 @@ void reset_orders()
 {
     cur_nat = NO_NATION;
     memset(orders_n, 0, sizeof orders_n);
+    targets_clear();
+    all_dirty = true;
 }
 
+void deadline_expired(void *data);
+
 void game_init()
 {
+    deadline_timer.callback = deadline_expired;
+
     memset(to_build, 0, sizeof to_build);
     reset_orders();
     print_date();
@@ -174,6 +250,36 @@ int get_season(const char *name)
     }
 }
 
+int get_state(const char *name)
+{
+    if (istrcmp(name, "main") == 0) {
+        return DEFAULT;
+    } else if (istrcmp(name, "retreat") == 0) {
+        return RETREAT;
+    } else if (istrcmp(name, "adjustment") == 0) {
+        return BUILD;
+    } else {
+        return -1;
+    }
+}
+
+const char *get_state_name(int state)
+{
+    switch (state) {
+    case DEFAULT:
+        return "main";
+
+    case RETREAT:
+        return "retreat";
+
+    case BUILD:
+        return "adjustment";
+
+    default:
+        return "!INVALID STATE!";
+    }
+}
+
 const char *get_season_name(enum season season)
 {
     switch (season) {
@@ -202,35 +308,53 @@ const char *get_era_name(enum era era)
     }
 }
 
-int pprint_order(struct order *o)
+static int sprint_order(char *buf, const struct order *o)
 {
     switch (o->kind) {
     case HOLD:
-        return pprintf("%s H", get_terr_name(o->t1));
+        return sprintf(buf, "%s H", get_terr_name(o->t1));
 
     case MOVE:
-        return pprintf("%s-%s%s%s", get_terr_name(o->t2),
-                                    get_terr_name(o->t3),
-                                    get_coast_name(o->coast),
-                                    o->viac ? " VIA C" : "");
+        return sprintf(buf, "%s-%s%s%s", get_terr_name(o->t2),
+                                         get_terr_name(o->t3),
+                                         get_coast_name(o->coast),
+                                         o->viac ? " VIA C" : "");
 
     case SUPH:
-        return pprintf("%s S %s", get_terr_name(o->t1),
-                                  get_terr_name(o->t2));
+        return sprintf(buf, "%s S %s", get_terr_name(o->t1),
+                                       get_terr_name(o->t2));
 
     case SUPM:
-        return pprintf("%s S %s-%s", get_terr_name(o->t1),
-                                     get_terr_name(o->t2),
-                                     get_terr_name(o->t3));
+        return sprintf(buf, "%s S %s-%s", get_terr_name(o->t1),
+                                          get_terr_name(o->t2),
+                                          get_terr_name(o->t3));
 
     case CONV:
-        return pprintf("%s C %s-%s", get_terr_name(o->t1),
-                                     get_terr_name(o->t2),
-                                     get_terr_name(o->t3));
+        return sprintf(buf, "%s C %s-%s", get_terr_name(o->t1),
+                                          get_terr_name(o->t2),
+                                          get_terr_name(o->t3));
 
     default:
-        return pprintf("!INVALID ORDER!");
+        return sprintf(buf, "!INVALID ORDER!");
+    }
+}
+
+int pprint_order(struct order *o)
+{
+    char buf[64];
+    return pputs(buf, sprint_order(buf, o));
+}
+
+static void pprint_order_line(size_t nat_i, size_t i)
+{
+    struct order_line *l = &order_lines[nat_i][i];
+
+    if (l->len == 0) {
+        l->len = sprint_order(l->text, &orders[nat_i][i]);
+        l->text[l->len++] = '\n';
     }
+
+    pputs(l->text, l->len);
 }
 
 int pprint_build_order(struct order *o)
@@ -250,7 +374,7 @@ void delete_orders(rangelist_t ranges)
 {
     size_t i = 0, j;
     size_t size = 16;
-    size_t *indices = malloc(size * sizeof *indices);
+    size_t *indices = xmalloc(size * sizeof *indices);
 
     rangelist_t l = ranges;
     while (l) {
@@ -272,13 +396,15 @@ void delete_orders(rangelist_t ranges)
 
     if (indices[0] == 0) {
         delete_error(0);
+        xfree(indices);
         return;
     }
 
     size_t n = orders_n_tot();
-    for (i = 0; i <= len; i++) {
+    for (i = 0; i < len; i++) {
         if (indices[i] > n) {
             delete_error(indices[i]);
+            xfree(indices);
             return;
         }
     }
@@ -290,9 +416,12 @@ void delete_orders(rangelist_t ranges)
     for (n = 0; n < NATIONS_N; n++) {
         k = 0;
         for (o = 0; o < orders_n[n]; o++) {
-            if (j == indices[i]) {
+            if (i < len && j == indices[i]) {
+                touch_order(&orders[n][o]);
+                targets_remove(1u << n, &orders[n][o]);
                 i++;
             } else {
+                order_lines[n][k] = order_lines[n][o];
                 orders[n][k++] = orders[n][o];
             }
 
@@ -302,7 +431,7 @@ void delete_orders(rangelist_t ranges)
         orders_n[n] = k;
     }
 
-    free(indices);
+    xfree(indices);
 }
 
 void delete_all_orders()
@@ -311,6 +440,9 @@ void delete_all_orders()
     for (n = 0; n < NATIONS_N; n++) {
         orders_n[n] = 0;
     }
+
+    targets_clear();
+    all_dirty = true;
 }
 
 /* TODO: list build orders in build phase */
@@ -326,18 +458,17 @@ void list_orders(enum cd_nation nat)
     size_t nat_i = trail0s(nat);
 
     if (orders_n[nat_i] == 0) {
-        pprintf("No orders from %s\n", get_nation_name(nat_i));
+        pprintf("No orders from %s\n", get_nation_name(nat));
         return;
     }
 
-    size_t base = get_orders_base_index(nat_i);
+    size_t base = get_orders_base_index(nat);
     int w = (int)decimal_places(base + orders_n[nat_i]);
 
     size_t i;
     for (i = 0; i < orders_n[nat_i]; i++) {
         pprintf("%*zu: ", w, base + i);
-        pprint_order(&orders[nat_i][i]);
-        pputchar('\n');
+        pprint_order_line(nat_i, i);
     }
 }
 
@@ -364,8 +495,7 @@ void list_all_orders()
         size_t j;
         for (j = 0; j < orders_n[n]; j++) {
             pprintf("%*zu: ", w, i++);
-            pprint_order(&orders[n][j]);
-            pputchar('\n');
+            pprint_order_line(n, j);
         }
     }
 
@@ -411,8 +541,70 @@ char *parse_tlist(char *s, terrlist_t *ret)
     return NULL;
 }
 
+static unsigned disband_dist[TERR_N];
+
+/* Farthest from a home center first, then fleets before armies, then
+ * alphabetically, as for a power in civil disorder */
+static int disband_cmp(const void *a, const void *b)
+{
+    enum cd_terr t1 = *(const enum cd_terr *)a;
+    enum cd_terr t2 = *(const enum cd_terr *)b;
+
+    if (disband_dist[t1] != disband_dist[t2]) {
+        return disband_dist[t1] > disband_dist[t2] ? -1 : 1;
+    }
+
+    if (board[t1].unit != board[t2].unit) {
+        return board[t1].unit == FLEET ? -1 : 1;
+    }
+
+    return t1 < t2 ? -1 : t1 > t2;
+}
+
+void disband_farthest(enum cd_nation nat, unsigned n)
+{
+    map_distances(home_centers[trail0s(nat)], disband_dist);
+
+    enum cd_terr units[TERR_N];
+    size_t units_n = 0;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (board[t].occupier == nat) {
+            units[units_n++] = t;
+        }
+    }
+
+    qsort(units, units_n, sizeof units[0], disband_cmp);
+
+    printf("%s disbands", get_nation_name(nat));
+
+    terrlist_t tlist = NULL;
+
+    size_t i;
+    for (i = 0; i < n && i < units_n; i++) {
+        printf(" %s", get_terr_name(units[i]));
+        tlist = terrlist_add(tlist, units[i]);
+    }
+
+    puts(" (civil disorder)");
+
+    clear_terrs(tlist);
+    terrlist_free(tlist);
+}
+
+void set_interactive(bool on)
+{
+    interactive = on;
+}
+
 void remove_units(enum cd_nation nat, unsigned n)
 {
+    if (deadline_passed || !interactive) {
+        disband_farthest(nat, n);
+        return;
+    }
+
     printf("%s has too many units, choose %u to be disbanded (units:",
            get_nation_name(nat), n);
 
@@ -426,16 +618,26 @@ void remove_units(enum cd_nation nat, unsigned n)
     puts(")");
 
     for (;;) {
+        unsigned long t0 = stats_now();
         char *line = readline("D" PROMPT);
+        stats_idle += stats_now() - t0;
+
+        if (line == NULL) {
+            putchar('\n');
+            disband_farthest(nat, n);
+            return;
+        }
 
         terrlist_t tlist;
         char *ret = parse_tlist(line, &tlist);
-        free(line);
         if (ret) {
-            printf("syntax error: invalid character or token `%s'", ret);
+            printf("syntax error: invalid character or token `%s'\n", ret);
+            free(line);
             continue;
         }
 
+        free(line);
+
         enum cd_terr invalid = NO_TERR;
         size_t count = 0;
 
@@ -450,11 +652,13 @@ void remove_units(enum cd_nation nat, unsigned n)
 
         if (invalid != NO_TERR) {
             printf("Cannot disband %s\n", get_terr_name(invalid));
+            terrlist_free(tlist);
             continue;
         }
 
         if (count != n) {
             printf("Must disband exactly %u units\n", n);
+            terrlist_free(tlist);
             continue;
         }
 
@@ -500,6 +704,14 @@ bool update_units()
 
 void advance_turn()
 {
+    struct stats_timer t;
+    stats_start(&t);
+
+    PROBE2(advance_turn__start, season, year);
+
+    int done_year = year;
+    enum season done_season = season;
+
     if (season == SPRING) {
         season = AUTUMN;
     } else {
@@ -527,6 +739,13 @@ void advance_turn()
     } else {
         set_state(DEFAULT);
     }
+
+    export_phase(done_year, done_season, season == SPRING ? to_build : NULL);
+    spectate_publish(state, 0);
+
+    PROBE3(advance_turn__done, season, year, build);
+
+    stats_stop(&t, STAGE_ADVANCE);
 }
 
 bool dislodged(enum cd_terr t)
@@ -575,11 +794,17 @@ void register_successful_move(struct order *o)
 
 void execute_moves()
 {
+    struct stats_timer t;
+    stats_start(&t);
+
+    PROBE1(execute_moves__start, successful_moves_n);
+
     size_t i;
     for (i = 0; i < successful_moves_n; i++) {
         struct move *m = &successful_moves[i];
         board[m->t1].occupier = NO_NATION;
         cd_clear_unit(m->t1);
+        touch_terr(m->t1);
     }
 
     for (i = 0; i < successful_moves_n; i++) {
@@ -587,173 +812,813 @@ void execute_moves()
         board[m->t2].occupier = m->nation;
         board[m->t2].unit     = m->unit;
         board[m->t2].coast    = m->coast;
-        cd_register_unit(m->t1, m->coast, m->unit, m->nation);
+        cd_register_unit(m->t2, m->coast, m->unit, m->nation);
+        touch_terr(m->t2);
     }
 
     successful_moves_n = 0;
+
+    spectate_publish(state, 0);
+
+    PROBE(execute_moves__done);
+
+    stats_stop(&t, STAGE_EXECUTE);
 }
 
-void adjudicate_orders()
+static enum outcome outcomes[NATIONS_N][TERR_N];
+
+static pthread_t worker;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static bool worker_done;
+static bool adjudicating = false;
+
+static int clusters[NATIONS_N][TERR_N];
+static bool selected[NATIONS_N * TERR_N];
+
+bool valid_order(size_t nat_i, size_t i)
 {
-    bool any = false;
+    return board[orders[nat_i][i].t1].occupier == (1u << nat_i);
+}
 
-    size_t nat_i, i;
-    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
-        for (i = 0; i < orders_n[nat_i]; i++) {
-            struct order *o = &orders[nat_i][i];
+bool in_cluster(size_t nat_i, size_t i, int c)
+{
+    if (!valid_order(nat_i, i)) {
+        return false;
+    }
 
-            any = true;
+    switch (c) {
+    case ALL_CLUSTERS:
+        return true;
 
-            if (board[o->t1].occupier != (1u << nat_i)) {
-                continue;
-            }
+    case SELECTED_CLUSTERS:
+        return selected[clusters[nat_i][i]];
 
-            switch (o->kind) {
-            case MOVE:
-                cd_register_move(o->t2, o->t3, o->coast, o->viac);
-                break;
+    default:
+        return clusters[nat_i][i] == c;
+    }
+}
 
-            case SUPH:
-                cd_register_suph(o->t1, o->t2);
-                break;
+bool register_order_with_adjudicator(const struct order *o)
+{
+    switch (o->kind) {
+    case MOVE:
+        cd_register_move(o->t2, o->t3, o->coast, o->viac);
+        return true;
 
-            case SUPM:
-                cd_register_supm(o->t1, o->t2, o->t3);
-                break;
+    case SUPH:
+        cd_register_suph(o->t1, o->t2);
+        return true;
 
-            case CONV:
-                cd_register_conv(o->t1, o->t2, o->t3);
-                break;
+    case SUPM:
+        cd_register_supm(o->t1, o->t2, o->t3);
+        return true;
 
-            default:
-                break;
-            }
-        }
+    case CONV:
+        cd_register_conv(o->t1, o->t2, o->t3);
+        return true;
+
+    default:
+        return false;
     }
+}
 
-    cd_run_adjudicator();
+void register_units_with_adjudicator(const struct terr_info position[])
+{
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        const struct terr_info *ti = &position[t];
 
-    pprintf_init();
-    pputchar('\n');
+        cd_clear_unit(t);
 
-    size_t j = 0;
+        if (ti->occupier != NO_NATION) {
+            cd_register_unit(t, ti->coast, ti->unit, ti->occupier);
+        }
+    }
+}
 
+void register_orders(int c)
+{
+    struct stats_timer t;
+    stats_start(&t);
+
+    size_t nat_i, i;
     for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
-        if (orders_n[nat_i] == 0) {
-            continue;
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            if (in_cluster(nat_i, i, c)) {
+                register_order_with_adjudicator(&orders[nat_i][i]);
+            }
         }
+    }
 
-        pprintf("%s\n", get_nation_name(1u << nat_i));
+    stats_stop(&t, STAGE_REGISTRATION);
+}
 
-        for (i = 0; i < orders_n[nat_i]; i++) {
-            struct order *o = &orders[nat_i][i];
-            int w = pprint_order(o);
+size_t count_orders()
+{
+    size_t n = 0;
 
-            int i;
-            for (i = 0; i < COL_WIDTH - w; i++) {
-                pputchar(' ');
-            }
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        n += orders_n[nat_i];
+    }
 
-            if (board[o->t1].occupier != (1u << nat_i)) {
-                pprintf(" [IGNORED]\n");
-                continue;
-            }
+    return n;
+}
 
-            if (o->kind == HOLD) {
-                if (dislodged(o->t1)) {
-                    pprintf(" [FAILS]\n");
-                } else {
-                    pprintf(" [SUCCEEDS]\n");
-                }
+static void run_adjudicator()
+{
+    struct stats_timer t;
+    stats_start(&t);
 
-                continue;
-            }
+    PROBE(adjudicator__start);
+    cd_run_adjudicator();
+    PROBE1(adjudicator__done, cd_retreats_n);
 
-            if (cd_resolutions[j] == SUCCEEDS) {
-                pprintf(" [SUCCEEDS]\n");
+    stats_stop(&t, STAGE_ADJUDICATOR);
+}
+
+void collect_outcomes(int c)
+{
+    size_t j = 0;
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            struct order *o = &orders[nat_i][i];
 
-                if (o->kind == MOVE) {
-                    register_successful_move(o);
+            if (!in_cluster(nat_i, i, c)) {
+                if (c == ALL_CLUSTERS) {
+                    outcomes[nat_i][i] = IGNORED;
                 }
+            } else if (o->kind == HOLD) {
+                outcomes[nat_i][i] = dislodged(o->t1) ? FAILURE : SUCCESS;
             } else {
-                pprintf(" [FAILS]\n");
+                outcomes[nat_i][i] = cd_resolutions[j++] == SUCCEEDS
+                                   ? SUCCESS
+                                   : FAILURE;
             }
-
-            j++;
         }
-
-        pputchar('\n');
     }
+}
 
-    if (!any) {
-        printf("No orders\n\n");
+enum cd_terr find_root(enum cd_terr parent[], enum cd_terr t)
+{
+    while (parent[t] != t) {
+        parent[t] = parent[parent[t]];
+        t = parent[t];
     }
 
-    reset_orders();
-
-    if (cd_retreats_n > 0) {
-        pprintf("Units dislodged:");
+    return t;
+}
 
-        for (i = 0; i < cd_retreats_n; i++) {
-            pprintf(" %s", get_terr_name(cd_retreats[i].who));
-        }
+static void join_terrs(enum cd_terr parent[], enum cd_terr a, enum cd_terr b)
+{
+    if (b == NO_TERR) {
+        return;
+    }
 
-        pputchar('\n');
+    parent[find_root(parent, a)] = find_root(parent, b);
+}
 
-        set_state(RETREAT);
-    } else {
-        execute_moves();
-        advance_turn();
+void join_order(enum cd_terr parent[], const struct order *o)
+{
+    if (o->kind != HOLD) {
+        join_terrs(parent, o->t1, o->t2);
+        join_terrs(parent, o->t1, o->t3);
     }
 }
 
-bool can_retreat(enum cd_terr t1,
-                 enum cd_terr t2,
-                 enum cd_coast coast)
+/* Orders can only interact through the territories they name, so the
+ * connected components of the territory graph spanned by t1-t2-t3 are
+ * independent subproblems */
+size_t partition_orders()
 {
-    size_t i;
-    for (i = 0; i < cd_retreats_n; i++) {
-        if (cd_retreats[i].who != t1) {
-            continue;
-        }
+    enum cd_terr parent[TERR_N];
+    int ids[TERR_N];
 
-        size_t j;
-        for (j = 0; j < cd_retreats[i].where_n; j++) {
-            if (cd_retreats[i].where[j].terr == t2
-                && cd_retreats[i].where[j].coasts & coast) {
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        parent[t] = t;
+        ids[t] = -1;
+    }
 
-                return true;
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            if (valid_order(nat_i, i)) {
+                join_order(parent, &orders[nat_i][i]);
             }
         }
-
-        break;
     }
 
-    return false;
-}
-
-void adjudicate_retreats()
-{
-    unsigned contenders[TERR_N];
-    memset(contenders, 0, sizeof contenders);
+    size_t n = 0;
 
-    size_t nat_i, i;
     for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
         for (i = 0; i < orders_n[nat_i]; i++) {
-            struct order *o = &orders[nat_i][i];
-
-            if (board[o->t1].occupier != (1u << nat_i)
-                || o->kind != MOVE) {
+            if (!valid_order(nat_i, i)) {
+                clusters[nat_i][i] = -1;
                 continue;
             }
 
-            if (can_retreat(o->t1, o->t3, o->coast)) {
-                contenders[o->t3]++;
+            enum cd_terr r = find_root(parent, orders[nat_i][i].t1);
+
+            if (ids[r] < 0) {
+                ids[r] = n++;
             }
+
+            clusters[nat_i][i] = ids[r];
         }
     }
 
-    pprintf_init();
+    return n;
+}
+
+void resolve_all()
+{
+    register_orders(ALL_CLUSTERS);
+    run_adjudicator();
+    collect_outcomes(ALL_CLUSTERS);
+}
+
+static struct {
+    bool valid;
+    unsigned char units[TERR_N][3];
+    bool ordered[TERR_N];
+    enum outcome by_terr[TERR_N];
+} last;
+
+void pack_units(unsigned char units[][3])
+{
+    memset(units, 0, TERR_N * sizeof units[0]);
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (board[t].occupier != NO_NATION) {
+            units[t][0] = board[t].unit;
+            units[t][1] = board[t].coast;
+            units[t][2] = board[t].occupier;
+        }
+    }
+}
+
+void remember_resolution()
+{
+    pack_units(last.units);
+    memset(last.ordered, 0, sizeof last.ordered);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            if (outcomes[nat_i][i] != IGNORED) {
+                enum cd_terr t1 = orders[nat_i][i].t1;
+
+                last.ordered[t1] = true;
+                last.by_terr[t1] = outcomes[nat_i][i];
+            }
+        }
+    }
+
+    last.valid = cd_retreats_n == 0;
+
+    memset(dirty_terrs, 0, sizeof dirty_terrs);
+    all_dirty = false;
+}
+
+bool order_is_clean(const struct order *o)
+{
+    return last.ordered[o->t1]
+           && !dirty_terrs[o->t1]
+           && (o->t2 == NO_TERR || !dirty_terrs[o->t2])
+           && (o->t3 == NO_TERR || !dirty_terrs[o->t3]);
+}
+
+/* Re-resolves only the clusters containing a territory named by an order
+ * changed since the last resolution, reusing the last outcome of every
+ * other order. Only attempted when the position is unchanged and nothing
+ * was dislodged, since retreat options are not local to a cluster. */
+bool resolve_incremental(size_t clusters_n)
+{
+    if (!last.valid || all_dirty) {
+        return false;
+    }
+
+    unsigned char units[TERR_N][3];
+    pack_units(units);
+
+    if (memcmp(units, last.units, sizeof units) != 0) {
+        return false;
+    }
+
+    memset(selected, 0, clusters_n * sizeof selected[0]);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            int c = clusters[nat_i][i];
+
+            if (c >= 0 && !order_is_clean(&orders[nat_i][i])) {
+                selected[c] = true;
+            }
+        }
+    }
+
+    size_t dirty_n = 0;
+
+    size_t c;
+    for (c = 0; c < clusters_n; c++) {
+        if (selected[c]) {
+            dirty_n++;
+        }
+    }
+
+    if (dirty_n == clusters_n) {
+        return false;
+    }
+
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            int c = clusters[nat_i][i];
+
+            if (c < 0) {
+                outcomes[nat_i][i] = IGNORED;
+            } else if (!selected[c]) {
+                outcomes[nat_i][i] = last.by_terr[orders[nat_i][i].t1];
+            }
+        }
+    }
+
+    cd_retreats_n = 0;
+
+    if (dirty_n > 0) {
+        register_orders(SELECTED_CLUSTERS);
+        run_adjudicator();
+        collect_outcomes(SELECTED_CLUSTERS);
+
+        if (cd_retreats_n > 0) {
+            resolve_all();
+        }
+    }
+
+    return true;
+}
+
+static bool same_retreat(const struct cd_retreat *a,
+                         const struct cd_retreat *b)
+{
+    if (a->who != b->who || a->where_n != b->where_n) {
+        return false;
+    }
+
+    size_t i, j;
+    for (i = 0; i < a->where_n; i++) {
+        for (j = 0; j < b->where_n; j++) {
+            if (a->where[i].terr == b->where[j].terr
+                && a->where[i].coasts == b->where[j].coasts) {
+                break;
+            }
+        }
+
+        if (j == b->where_n) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void verify_resolution()
+{
+    static enum outcome incremental[NATIONS_N][TERR_N];
+    memcpy(incremental, outcomes, sizeof outcomes);
+
+    static struct cd_retreat retreats[TERR_N];
+    size_t retreats_n = cd_retreats_n;
+    memcpy(retreats, cd_retreats, retreats_n * sizeof retreats[0]);
+
+    resolve_all();
+
+    bool match = true;
+    size_t n = 1;
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++, n++) {
+            if (incremental[nat_i][i] != outcomes[nat_i][i]) {
+                fprintf(stderr, "verify: order %zu resolved incrementally "
+                                "does not match full adjudication\n", n);
+                match = false;
+            }
+        }
+    }
+
+    if (retreats_n != cd_retreats_n) {
+        fprintf(stderr, "verify: %zu dislodgements resolved incrementally, "
+                        "%zu by full adjudication\n",
+                        retreats_n, cd_retreats_n);
+        match = false;
+    } else {
+        /* Same dislodgements in any order, each with the same options */
+        for (i = 0; i < retreats_n; i++) {
+            size_t j;
+            for (j = 0; j < cd_retreats_n; j++) {
+                if (cd_retreats[j].who == retreats[i].who) {
+                    break;
+                }
+            }
+
+            if (j == cd_retreats_n || !same_retreat(&retreats[i],
+                                                    &cd_retreats[j])) {
+                fprintf(stderr, "verify: retreat of %s resolved "
+                                "incrementally does not match full "
+                                "adjudication\n",
+                                get_terr_name(retreats[i].who));
+                match = false;
+            }
+        }
+    }
+
+    if (!match) {
+        verify_mismatches++;
+    }
+}
+
+void set_verify(bool on)
+{
+    verify_incremental = on;
+}
+
+struct resolution_key {
+    unsigned char units[TERR_N][3];
+    unsigned char orders[TERR_N][5];
+};
+
+struct resolution {
+    enum outcome by_terr[TERR_N];
+    size_t retreats_n;
+};
+
+void make_resolution_key(struct resolution_key *key)
+{
+    memset(key, 0, sizeof *key);
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        enum cd_nation nat = board[t].occupier;
+
+        if (nat == NO_NATION) {
+            continue;
+        }
+
+        key->units[t][0] = board[t].unit;
+        key->units[t][1] = board[t].coast;
+        key->units[t][2] = nat;
+
+        size_t nat_i = trail0s(nat);
+        size_t i = find_order(nat, t);
+
+        if (i < orders_n[nat_i]) {
+            struct order *o = &orders[nat_i][i];
+
+            key->orders[t][0] = o->kind;
+            key->orders[t][1] = o->t2;
+            key->orders[t][2] = o->t3;
+            key->orders[t][3] = o->coast;
+            key->orders[t][4] = o->viac;
+        }
+    }
+}
+
+bool lookup_resolution(const struct resolution_key *key)
+{
+    size_t size;
+    const struct resolution *r = cache_lookup(key, sizeof *key, &size);
+
+    if (r == NULL) {
+        return false;
+    }
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            struct order *o = &orders[nat_i][i];
+
+            outcomes[nat_i][i] = board[o->t1].occupier == (1u << nat_i)
+                               ? r->by_terr[o->t1]
+                               : IGNORED;
+        }
+    }
+
+    cd_retreats_n = r->retreats_n;
+    memcpy(cd_retreats, r + 1, r->retreats_n * sizeof cd_retreats[0]);
+
+    return true;
+}
+
+void store_resolution(const struct resolution_key *key)
+{
+    size_t size = sizeof (struct resolution)
+                + cd_retreats_n * sizeof cd_retreats[0];
+
+    struct resolution *r = xmalloc(size);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            if (outcomes[nat_i][i] != IGNORED) {
+                r->by_terr[orders[nat_i][i].t1] = outcomes[nat_i][i];
+            }
+        }
+    }
+
+    r->retreats_n = cd_retreats_n;
+    memcpy(r + 1, cd_retreats, cd_retreats_n * sizeof cd_retreats[0]);
+
+    cache_insert(key, sizeof *key, r, size);
+    xfree(r);
+}
+
+void resolve_orders()
+{
+    struct resolution_key key;
+    make_resolution_key(&key);
+
+    if (lookup_resolution(&key)) {
+        remember_resolution();
+        return;
+    }
+
+    size_t clusters_n = partition_orders();
+
+    bool incremental = resolve_incremental(clusters_n);
+
+    if (incremental) {
+        resolved_incrementally++;
+    } else {
+        resolve_all();
+    }
+
+    if (incremental && verify_incremental) {
+        verify_resolution();
+    }
+
+    remember_resolution();
+    store_resolution(&key);
+}
+
+void *adjudication_worker(void *data)
+{
+    (void)data;
+
+    resolve_orders();
+
+    pthread_mutex_lock(&worker_lock);
+    worker_done = true;
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+
+    return NULL;
+}
+
+void print_outcomes()
+{
+    struct stats_timer t;
+    stats_start(&t);
+
+    pprintf_init();
+    pputchar('\n');
+
+    bool any = false;
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        if (orders_n[nat_i] == 0) {
+            continue;
+        }
+
+        any = true;
+
+        pprintf("%s\n", get_nation_name(1u << nat_i));
+
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            int w = pprint_order(&orders[nat_i][i]);
+
+            int k;
+            for (k = 0; k < COL_WIDTH - w; k++) {
+                pputchar(' ');
+            }
+
+            switch (outcomes[nat_i][i]) {
+            case IGNORED:
+                pprintf(" [IGNORED]\n");
+                break;
+
+            case SUCCESS:
+                pprintf(" [SUCCEEDS]\n");
+                break;
+
+            case FAILURE:
+                pprintf(" [FAILS]\n");
+                break;
+            }
+        }
+
+        pputchar('\n');
+    }
+
+    if (!any) {
+        printf("No orders\n\n");
+    }
+
+    if (cd_retreats_n > 0) {
+        pprintf("Units dislodged:");
+
+        for (i = 0; i < cd_retreats_n; i++) {
+            pprintf(" %s", get_terr_name(cd_retreats[i].who));
+        }
+
+        pputchar('\n');
+    }
+
+    stats_stop(&t, STAGE_RENDER);
+}
+
+void commit_orders()
+{
+    print_outcomes();
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            struct order *o = &orders[nat_i][i];
+
+            if (o->kind == MOVE && outcomes[nat_i][i] == SUCCESS) {
+                register_successful_move(o);
+            }
+        }
+    }
+
+    explain_remember(orders, orders_n, outcomes);
+    spectate_resolution(orders, orders_n, outcomes);
+
+    reset_orders();
+
+    if (cd_retreats_n > 0) {
+        export_dislodged();
+        set_state(RETREAT);
+        spectate_publish(state, cd_retreats_n);
+    } else {
+        execute_moves();
+        advance_turn();
+        board_diff_end();
+    }
+}
+
+size_t nation_orders(enum cd_nation nat, const struct order **ret)
+{
+    size_t nat_i = trail0s(nat);
+
+    *ret = orders[nat_i];
+    return orders_n[nat_i];
+}
+
+bool awaiting_orders()
+{
+    return state == DEFAULT;
+}
+
+enum outcome get_outcome(enum cd_nation nat, enum cd_terr t1)
+{
+    size_t nat_i = trail0s(nat);
+    size_t i = find_order(nat, t1);
+
+    return i < orders_n[nat_i] ? outcomes[nat_i][i] : IGNORED;
+}
+
+void preview()
+{
+    VALIDATE_STATE_NOT(RETREAT, BUILD);
+
+    resolve_orders();
+    print_outcomes();
+}
+
+bool adjudication_pending()
+{
+    if (!adjudicating) {
+        return false;
+    }
+
+    pthread_mutex_lock(&worker_lock);
+    bool ret = worker_done;
+    pthread_mutex_unlock(&worker_lock);
+
+    return ret;
+}
+
+void adjudication_wait()
+{
+    if (!adjudicating) {
+        return;
+    }
+
+    pthread_join(worker, NULL);
+    adjudicating = false;
+
+    commit_orders();
+}
+
+void adjudication_poll()
+{
+    if (adjudication_pending()) {
+        adjudication_wait();
+    }
+}
+
+void adjudicate_orders()
+{
+    worker_done = false;
+
+    /* Expiring now would hold unordered units under the worker; the
+     * phase that follows arms its own deadline */
+    timer_disarm(&deadline_timer);
+
+    if (pthread_create(&worker, NULL, adjudication_worker, NULL) != 0) {
+        adjudication_worker(NULL);
+        commit_orders();
+        return;
+    }
+
+    adjudicating = true;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += ADJUDICATION_GRACE_MS * 1000000l;
+    ts.tv_sec += ts.tv_nsec / 1000000000l;
+    ts.tv_nsec %= 1000000000l;
+
+    pthread_mutex_lock(&worker_lock);
+    while (!worker_done) {
+        if (pthread_cond_timedwait(&worker_cond, &worker_lock, &ts) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&worker_lock);
+
+    if (adjudication_pending()) {
+        adjudication_wait();
+    } else {
+        puts("Adjudicating in background, results will follow");
+    }
+}
+
+bool can_retreat(enum cd_terr t1,
+                 enum cd_terr t2,
+                 enum cd_coast coast)
+{
+    size_t i;
+    for (i = 0; i < cd_retreats_n; i++) {
+        if (cd_retreats[i].who != t1) {
+            continue;
+        }
+
+        size_t j;
+        for (j = 0; j < cd_retreats[i].where_n; j++) {
+            if (cd_retreats[i].where[j].terr == t2
+                && cd_retreats[i].where[j].coasts & coast) {
+
+                return true;
+            }
+        }
+
+        break;
+    }
+
+    return false;
+}
+
+void adjudicate_retreats()
+{
+    unsigned contenders[TERR_N];
+    memset(contenders, 0, sizeof contenders);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            struct order *o = &orders[nat_i][i];
+
+            if (board[o->t1].occupier != (1u << nat_i)
+                || o->kind != MOVE) {
+                continue;
+            }
+
+            if (can_retreat(o->t1, o->t3, o->coast)) {
+                contenders[o->t3]++;
+            }
+        }
+    }
+
+    pprintf_init();
     pputchar('\n');
 
     bool any = false;
@@ -809,6 +1674,7 @@ void adjudicate_retreats()
     execute_moves();
 
     advance_turn();
+    board_diff_end();
 }
 
 void execute_build_orders()
@@ -874,6 +1740,7 @@ void execute_build_orders()
             board[o->t1].occupier = nat;
             board[o->t1].coast    = o->coast;
             board[o->t1].unit     = o->unit;
+            touch_terr(o->t1);
 
             pprintf(" [SUCCEEDS]\n");
         }
@@ -884,10 +1751,22 @@ void execute_build_orders()
     reset_orders();
 
     set_state(DEFAULT);
+    spectate_publish(state, 0);
+    board_diff_end();
 }
 
 void adjudicate()
 {
+    if (adjudicating) {
+        return;
+    }
+
+    drain_submissions();
+
+    PROBE3(adjudicate__start, state, season, count_orders());
+
+    board_diff_begin();
+
     switch (state) {
     case DEFAULT:
         adjudicate_orders();
@@ -904,6 +1783,8 @@ void adjudicate()
     default:
         break;
     }
+
+    PROBE2(adjudicate__done, state, adjudicating);
 }
 
 size_t find_order(enum cd_nation nat, enum cd_terr terr)
@@ -928,19 +1809,57 @@ void register_order(enum cd_nation nat,
                     enum cd_coast coast,
                     bool viac)
 {
+    struct stats_timer t;
+    stats_start(&t);
+
+    PROBE3(register_order__start, nat, kind, t1);
+
     size_t nat_i = trail0s(nat);
     size_t i = find_order(nat, t1);
 
+    if (i < orders_n[nat_i]) {
+        touch_order(&orders[nat_i][i]);
+        targets_remove(nat, &orders[nat_i][i]);
+    }
+
     orders[nat_i][i].kind  = kind;
     orders[nat_i][i].t1    = t1;
     orders[nat_i][i].t2    = t2;
     orders[nat_i][i].t3    = t3;
     orders[nat_i][i].coast = coast;
     orders[nat_i][i].viac  = viac;
+    order_lines[nat_i][i].len = 0;
 
     if (i >= orders_n[nat_i]) {
         orders_n[nat_i]++;
     }
+
+    touch_order(&orders[nat_i][i]);
+    targets_add(nat, &orders[nat_i][i]);
+
+    PROBE2(register_order__done, nat, orders_n[nat_i]);
+
+    stats_stop(&t, STAGE_REGISTER_ORDER);
+}
+
+void withdraw_order(enum cd_nation nat, enum cd_terr t1)
+{
+    size_t nat_i = trail0s(nat);
+    size_t i = find_order(nat, t1);
+
+    if (i >= orders_n[nat_i]) {
+        return;
+    }
+
+    touch_order(&orders[nat_i][i]);
+    targets_remove(nat, &orders[nat_i][i]);
+
+    memmove(&orders[nat_i][i], &orders[nat_i][i+1],
+            (orders_n[nat_i] - i - 1) * sizeof orders[nat_i][0]);
+    memmove(&order_lines[nat_i][i], &order_lines[nat_i][i+1],
+            (orders_n[nat_i] - i - 1) * sizeof order_lines[nat_i][0]);
+
+    orders_n[nat_i]--;
 }
 
 void order_hold(terrlist_t tlist)
@@ -955,12 +1874,102 @@ void order_hold(terrlist_t tlist)
     }
 }
 
+/* Orders are checked against the map when the units they name are on the
+ * board; orders for units yet to be placed are accepted as they are */
+bool can_reach(enum cd_terr t1, enum cd_terr t2, enum cd_coast coast,
+               bool viac)
+{
+    const struct terr_info *ti = &board[t1];
+
+    if (ti->occupier == NO_NATION) {
+        return true;
+    }
+
+    if (ti->unit == ARMY && (viac || !map_adjacent(t1, ARMY, NO_COAST, t2))) {
+        return map_can_convoy(t1, t2);
+    }
+
+    return !viac && map_can_move(t1, ti->unit, ti->coast, t2, coast);
+}
+
+bool can_support(enum cd_terr t1, enum cd_terr t2)
+{
+    const struct terr_info *ti = &board[t1];
+
+    return ti->occupier == NO_NATION
+           || map_adjacent(t1, ti->unit, ti->coast, t2);
+}
+
+bool can_convoy(enum cd_terr t1, enum cd_terr t2, enum cd_terr t3)
+{
+    const struct terr_info *ti = &board[t1];
+
+    if (ti->occupier != NO_NATION && (ti->unit != FLEET || !is_sea(t1))) {
+        return false;
+    }
+
+    if (board[t2].occupier != NO_NATION && board[t2].unit != ARMY) {
+        return false;
+    }
+
+    return map_can_convoy(t2, t3);
+}
+
+void illegal_order(struct order *o)
+{
+    pprintf_init();
+    pprintf("Illegal order: ");
+    pprint_order(o);
+    pputchar('\n');
+}
+
+bool legal_order(const struct order *o)
+{
+    switch (o->kind) {
+    case MOVE:
+        return can_reach(o->t2, o->t3, o->coast, o->viac);
+
+    case SUPH:
+        return can_support(o->t1, o->t2);
+
+    case SUPM:
+        return o->t1 != o->t2
+               && can_support(o->t1, o->t3)
+               && can_reach(o->t2, o->t3, NO_COAST, false);
+
+    case CONV:
+        return can_convoy(o->t1, o->t2, o->t3);
+
+    default:
+        return true;
+    }
+}
+
+/* State and map checks shared by the prompt and queued submissions; the
+ * map is only checked while movement orders are awaited */
+bool enter_order(enum cd_nation nat, struct order *o)
+{
+    if (state == BUILD) {
+        printf("Cannot do that now (%s)\n", state_names[state]);
+        return false;
+    }
+
+    if (state == DEFAULT && !legal_order(o)) {
+        illegal_order(o);
+        return false;
+    }
+
+    register_order(nat, o->kind, o->t1, o->t2, o->t3, o->coast, o->viac);
+    return true;
+}
+
 void order_move(enum cd_terr t2, struct terr_coast t3c, bool viac)
 {
     VALIDATE_STATE_NOT(BUILD);
     VALIDATE_CUR_NAT();
 
-    register_order(cur_nat, MOVE, t2, t2, t3c.terr, t3c.coast, viac);
+    struct order o = {MOVE, t2, t2, {t3c.terr}, t3c.coast, viac};
+    enter_order(cur_nat, &o);
 }
 
 void order_suph(terrlist_t tlist, enum cd_terr t2)
@@ -969,8 +1978,9 @@ void order_suph(terrlist_t tlist, enum cd_terr t2)
     VALIDATE_CUR_NAT();
 
     while (tlist) {
-        register_order(cur_nat, SUPH, tlist->item, t2,
-                       NO_TERR, NO_COAST, false);
+        struct order o = {SUPH, tlist->item, t2, {NO_TERR}, NO_COAST, false};
+        enter_order(cur_nat, &o);
+
         LIST_ADVANCE(tlist);
     }
 }
@@ -981,7 +1991,9 @@ void order_supm(terrlist_t tlist, enum cd_terr t2, enum cd_terr t3)
     VALIDATE_CUR_NAT();
 
     while (tlist) {
-        register_order(cur_nat, SUPM, tlist->item, t2, t3, NO_COAST, false);
+        struct order o = {SUPM, tlist->item, t2, {t3}, NO_COAST, false};
+        enter_order(cur_nat, &o);
+
         LIST_ADVANCE(tlist);
     }
 }
@@ -992,7 +2004,9 @@ void order_conv(terrlist_t tlist, enum cd_terr t2, enum cd_terr t3)
     VALIDATE_CUR_NAT();
 
     while (tlist) {
-        register_order(cur_nat, CONV, tlist->item, t2, t3, NO_COAST, false);
+        struct order o = {CONV, tlist->item, t2, {t3}, NO_COAST, false};
+        enter_order(cur_nat, &o);
+
         LIST_ADVANCE(tlist);
     }
 }
@@ -1025,6 +2039,7 @@ void order_build(tclist_t tclist, enum cd_unit unit)
         orders[nat_i][i].t1    = tclist->item.terr;
         orders[nat_i][i].coast = tclist->item.coast;
         orders[nat_i][i].unit  = unit;
+        order_lines[nat_i][i].len = 0;
 
         if (i >= orders_n[nat_i]) {
             orders_n[nat_i]++;
@@ -1033,3 +2048,62 @@ void order_build(tclist_t tclist, enum cd_unit unit)
         LIST_ADVANCE(tclist);
     }
 }
+
+void hold_unordered_units()
+{
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        enum cd_nation nat = board[t].occupier;
+
+        if (nat != NO_NATION
+            && find_order(nat, t) >= orders_n[trail0s(nat)]) {
+
+            register_order(nat, HOLD, t, NO_TERR, NO_TERR, NO_COAST, false);
+        }
+    }
+}
+
+void deadline_expired(void *data)
+{
+    (void)data;
+
+    printf("\nDeadline expired (%s)\n", state_names[state]);
+
+    deadline_passed = true;
+
+    if (state == DEFAULT) {
+        hold_unordered_units();
+    }
+
+    adjudicate();
+}
+
+void set_deadline(int s, unsigned seconds)
+{
+    deadlines[s] = seconds;
+
+    if (s == (int)state) {
+        arm_deadline();
+    }
+}
+
+void clear_deadlines()
+{
+    memset(deadlines, 0, sizeof deadlines);
+    timer_disarm(&deadline_timer);
+}
+
+void print_deadline()
+{
+    if (!deadline_timer.armed) {
+        puts("No deadline set");
+        return;
+    }
+
+    unsigned long s = (timer_remaining(&deadline_timer) + 999) / 1000;
+
+    printf("Deadline for %s in %lu:%02lu:%02lu\n", state_names[state],
+                                                  s / 3600,
+                                                  s / 60 % 60,
+                                                  s % 60);
+}
@@ -29,6 +29,14 @@
 
 extern enum cd_nation cur_nat;
 
+/* Phases resolved by re-resolving only the clusters with changed
+ * orders */
+extern size_t resolved_incrementally;
+
+/* Incremental resolutions that 'set verify on' found to differ from a
+ * full adjudication */
+extern size_t verify_mismatches;
+
 enum era {
     BC = -1,
     AD = 1
@@ -43,9 +51,11 @@ extern int year;
 extern enum season season;
 
 int get_season(const char *name);
+int get_state(const char *name);
 
 const char *get_era_name(enum era era);
 const char *get_season_name(enum season season);
+const char *get_state_name(int state);
 
 enum order_kind {
     NULL_ORDER,
@@ -70,12 +80,32 @@ struct order {
     bool viac;
 };
 
+enum outcome {
+    IGNORED,
+    SUCCESS,
+    FAILURE
+};
+
 void game_init();
 void phase_init();
 
 void set_year();
+void print_date();
 void select_nation();
 
+size_t find_order(enum cd_nation nat, enum cd_terr terr);
+size_t get_orders_base_index(enum cd_nation nat);
+void register_order(enum cd_nation nat,
+                    enum order_kind kind,
+                    enum cd_terr t1,
+                    enum cd_terr t2,
+                    enum cd_terr t3,
+                    enum cd_coast coast,
+                    bool viac);
+void withdraw_order(enum cd_nation nat, enum cd_terr t1);
+bool legal_order(const struct order *o);
+bool enter_order(enum cd_nation nat, struct order *o);
+
 void order_hold(terrlist_t tlist);
 void order_move(enum cd_terr t2, struct terr_coast t3c, bool viac);
 void order_suph(terrlist_t tlist, enum cd_terr t2);
@@ -88,6 +118,32 @@ void delete_orders(rangelist_t ranges);
 void delete_all_orders();
 void list_orders(enum cd_nation nat);
 void list_all_orders();
+int pprint_order(struct order *o);
+bool dislodged(enum cd_terr t);
+void resolve_orders();
+enum outcome get_outcome(enum cd_nation nat, enum cd_terr t1);
+
+/* Shared with the speculative adjudications of explain, suggest and
+ * rollout. join_order links the territories an order names, so that
+ * after all orders are joined two territories share a find_root
+ * exactly when orders connect them */
+bool register_order_with_adjudicator(const struct order *o);
+void register_units_with_adjudicator(const struct terr_info position[]);
+void join_order(enum cd_terr parent[], const struct order *o);
+enum cd_terr find_root(enum cd_terr parent[], enum cd_terr t);
+
 void adjudicate();
+bool awaiting_orders();
+size_t nation_orders(enum cd_nation nat, const struct order **ret);
+void preview();
+void set_verify(bool on);
+void set_interactive(bool on);
+bool adjudication_pending();
+void adjudication_wait();
+void adjudication_poll();
+
+void set_deadline(int state, unsigned seconds);
+void clear_deadlines();
+void print_deadline();
 
 #endif /* _GAME_H_ */
@@ -0,0 +1,627 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "import.h"
+
+/* Reads DPjudge-style result archives, e.g.
+ *
+ *   Movement results for Spring of 1901.  (game.19010SM)
+ *
+ *   Austria:  Army  Budapest -> Serbia.
+ *   France:   Army  Marseilles SUPPORT Army Paris -> Burgundy.
+ *   Russia:   Fleet St. Petersburg (south coast) -> Gulf of Bothnia.
+ *   Turkey:   Fleet Ankara CONVOY Army Smyrna -> Armenia.  (*bounce*)
+ *
+ * straight from a read-only mapping of the file, one line at a time
+ * and without copying. Anything that is neither a phase header nor an
+ * order line (mail headers, ownership and dislodgement reports, ...) is
+ * passed over, and so are retreat and adjustment phases */
+
+static const struct {
+    const char *name;
+    const char *abbrs[3];
+} full_names[] = {
+    {"Adriatic Sea",          {"adr"}},
+    {"Aegean Sea",            {"aeg"}},
+    {"Albania",               {"alb"}},
+    {"Ankara",                {"ank"}},
+    {"Apulia",                {"apu"}},
+    {"Armenia",               {"arm"}},
+    {"Baltic Sea",            {"bal"}},
+    {"Barents Sea",           {"bar"}},
+    {"Belgium",               {"bel"}},
+    {"Berlin",                {"ber"}},
+    {"Black Sea",             {"bla"}},
+    {"Bohemia",               {"boh"}},
+    {"Brest",                 {"bre"}},
+    {"Budapest",              {"bud"}},
+    {"Bulgaria",              {"bul"}},
+    {"Burgundy",              {"bur"}},
+    {"Clyde",                 {"cly"}},
+    {"Constantinople",        {"con"}},
+    {"Denmark",               {"den"}},
+    {"Eastern Mediterranean", {"eas", "emed"}},
+    {"Edinburgh",             {"edi"}},
+    {"English Channel",       {"eng", "ech"}},
+    {"Finland",               {"fin"}},
+    {"Galicia",               {"gal"}},
+    {"Gascony",               {"gas"}},
+    {"Greece",                {"gre"}},
+    {"Gulf of Bothnia",       {"bot", "gob"}},
+    {"Gulf of Lyon",          {"lyo", "gol"}},
+    {"Gulf of Lyons",         {"lyo", "gol"}},
+    {"Helgoland Bight",       {"hel"}},
+    {"Heligoland Bight",      {"hel"}},
+    {"Holland",               {"hol"}},
+    {"Ionian Sea",            {"ion"}},
+    {"Irish Sea",             {"iri"}},
+    {"Kiel",                  {"kie"}},
+    {"Liverpool",             {"lvp", "lpl"}},
+    {"Livonia",               {"lvn", "lvo", "liv"}},
+    {"London",                {"lon"}},
+    {"Marseilles",            {"mar"}},
+    {"Mid-Atlantic Ocean",    {"mao", "mid"}},
+    {"Mid Atlantic Ocean",    {"mao", "mid"}},
+    {"Moscow",                {"mos"}},
+    {"Munich",                {"mun"}},
+    {"Naples",                {"nap"}},
+    {"North Africa",          {"naf"}},
+    {"North Atlantic Ocean",  {"nao", "nat"}},
+    {"North Sea",             {"nth", "nts"}},
+    {"Norway",                {"nwy", "nor"}},
+    {"Norwegian Sea",         {"nwg", "nrg"}},
+    {"Paris",                 {"par"}},
+    {"Picardy",               {"pic"}},
+    {"Piedmont",              {"pie"}},
+    {"Portugal",              {"por"}},
+    {"Prussia",               {"pru"}},
+    {"Rome",                  {"rom"}},
+    {"Ruhr",                  {"ruh"}},
+    {"Rumania",               {"rum"}},
+    {"Serbia",                {"ser"}},
+    {"Sevastopol",            {"sev"}},
+    {"Silesia",               {"sil"}},
+    {"Skagerrak",             {"ska"}},
+    {"Smyrna",                {"smy"}},
+    {"Spain",                 {"spa"}},
+    {"St. Petersburg",        {"stp"}},
+    {"St Petersburg",         {"stp"}},
+    {"Saint Petersburg",      {"stp"}},
+    {"Sweden",                {"swe"}},
+    {"Syria",                 {"syr"}},
+    {"Trieste",               {"tri"}},
+    {"Tunis",                 {"tun"}},
+    {"Tuscany",               {"tus"}},
+    {"Tyrolia",               {"tyr"}},
+    {"Tyrrhenian Sea",        {"tys", "tyn"}},
+    {"Ukraine",               {"ukr"}},
+    {"Venice",                {"ven"}},
+    {"Vienna",                {"vie"}},
+    {"Wales",                 {"wal"}},
+    {"Warsaw",                {"war"}},
+    {"Western Mediterranean", {"wes", "wmed"}},
+    {"Yorkshire",             {"yor"}}
+};
+
+#define LETTER_NAMES_MAX 16
+
+static enum cd_terr full_name_terrs[ARRSIZE(full_names)];
+static size_t full_name_lens[ARRSIZE(full_names)];
+
+/* Indices into full_names by initial */
+static unsigned char by_letter[26][LETTER_NAMES_MAX];
+static size_t by_letter_n[26];
+
+static bool names_resolved = false;
+
+static void resolve_names()
+{
+    if (names_resolved) {
+        return;
+    }
+
+    size_t i, j;
+    for (i = 0; i < ARRSIZE(full_names); i++) {
+        full_name_terrs[i] = NO_TERR;
+        full_name_lens[i] = strlen(full_names[i].name);
+
+        size_t l = tolower(*full_names[i].name) - 'a';
+        assert(by_letter_n[l] < LETTER_NAMES_MAX);
+        by_letter[l][by_letter_n[l]++] = i;
+
+        for (j = 0; j < 3 && full_names[i].abbrs[j] != NULL; j++) {
+            int t = get_terr(full_names[i].abbrs[j]);
+
+            if (t != NO_TERR) {
+                full_name_terrs[i] = t;
+                break;
+            }
+        }
+    }
+
+    names_resolved = true;
+}
+
+static const char *skip_blanks(const char *c, const char *eol)
+{
+    while (c < eol && (*c == ' ' || *c == '\t')) {
+        c++;
+    }
+
+    return c;
+}
+
+static const char *prefix(const char *c, const char *eol, const char *s)
+{
+    size_t len = strlen(s);
+
+    if ((size_t)(eol - c) < len || strncasecmp(c, s, len) != 0) {
+        return NULL;
+    }
+
+    return c + len;
+}
+
+/* Like prefix, but s must be followed by a word boundary, and trailing
+ * blanks are consumed */
+static const char *word(const char *c, const char *eol, const char *s)
+{
+    const char *e = prefix(c, eol, s);
+
+    if (e == NULL || (e < eol && isalnum((unsigned char)*e))) {
+        return NULL;
+    }
+
+    return skip_blanks(e, eol);
+}
+
+/* Copies the alphabetic word at c into buf, NUL-terminated */
+static const char *copy_word(const char *c, const char *eol,
+                             char *buf, size_t size)
+{
+    size_t n = 0;
+
+    while (c < eol && isalpha((unsigned char)*c)) {
+        if (n + 1 >= size) {
+            return NULL;
+        }
+
+        buf[n++] = *c++;
+    }
+
+    buf[n] = '\0';
+
+    return n > 0 ? c : NULL;
+}
+
+static const char *parse_coast(const char *c, const char *eol,
+                               enum cd_coast *coast)
+{
+    const char *d = skip_blanks(c, eol);
+    const char *e;
+
+    *coast = NO_COAST;
+
+    if (d >= eol || (*d != '(' && *d != '/')) {
+        return c;
+    }
+
+    bool paren = *d++ == '(';
+
+    if ((e = prefix(d, eol, "north coast")) || (e = prefix(d, eol, "nc"))) {
+        *coast = NORTH;
+    } else if ((e = prefix(d, eol, "south coast"))
+               || (e = prefix(d, eol, "sc"))) {
+        *coast = SOUTH;
+    } else {
+        return c;
+    }
+
+    if (paren) {
+        if (e >= eol || *e != ')') {
+            *coast = NO_COAST;
+            return c;
+        }
+
+        e++;
+    }
+
+    return e;
+}
+
+/* Longest full name first, so that e.g. "North Sea" never shadows
+ * "North Atlantic Ocean"; bare abbreviations are accepted too */
+static const char *parse_terr(const char *c, const char *eol,
+                              enum cd_terr *terr, enum cd_coast *coast)
+{
+    size_t best = 0;
+    *terr = NO_TERR;
+
+    if (c >= eol || !isalpha((unsigned char)*c)) {
+        return NULL;
+    }
+
+    size_t l = tolower((unsigned char)*c) - 'a';
+
+    size_t j;
+    for (j = 0; j < by_letter_n[l]; j++) {
+        size_t i = by_letter[l][j];
+        size_t len = full_name_lens[i];
+
+        if (len <= best) {
+            continue;
+        }
+
+        const char *e = prefix(c, eol, full_names[i].name);
+
+        if (e != NULL && (e == eol || !isalnum((unsigned char)*e))) {
+            best = len;
+            *terr = full_name_terrs[i];
+        }
+    }
+
+    if (best > 0) {
+        c += best;
+    } else {
+        char buf[8];
+
+        c = copy_word(c, eol, buf, sizeof buf);
+        if (c == NULL) {
+            return NULL;
+        }
+
+        *terr = get_terr(buf);
+    }
+
+    if (*terr == NO_TERR) {
+        return NULL;
+    }
+
+    return skip_blanks(parse_coast(c, eol, coast), eol);
+}
+
+static const char *parse_unit(const char *c, const char *eol,
+                              enum cd_unit *unit)
+{
+    const char *e;
+
+    if ((e = word(c, eol, "army")) || (e = word(c, eol, "a"))) {
+        *unit = ARMY;
+    } else if ((e = word(c, eol, "fleet")) || (e = word(c, eol, "f"))) {
+        *unit = FLEET;
+    }
+
+    return e;
+}
+
+static const char *parse_order(const char *c, const char *eol,
+                               struct order *o)
+{
+    enum cd_coast coast;
+    enum cd_unit unit;
+    const char *e;
+
+    o->t2 = o->t1;
+    o->t3 = NO_TERR;
+    o->coast = NO_COAST;
+    o->viac = false;
+
+    if ((e = word(c, eol, "hold")) || (e = word(c, eol, "holds"))) {
+        o->kind = HOLD;
+        return e;
+    }
+
+    if ((e = word(c, eol, "->")) || (e = word(c, eol, "-"))) {
+        o->kind = MOVE;
+
+        e = parse_terr(e, eol, &o->t3, &o->coast);
+
+        /* Convoyed moves list every sea on the way */
+        while (e != NULL && (c = word(e, eol, "->")) != NULL) {
+            o->viac = true;
+            e = parse_terr(c, eol, &o->t3, &o->coast);
+        }
+
+        if (e != NULL && (c = word(e, eol, "via convoy")) != NULL) {
+            o->viac = true;
+            e = c;
+        }
+
+        return e;
+    }
+
+    if ((e = word(c, eol, "support")) || (e = word(c, eol, "supports"))) {
+        o->kind = SUPH;
+    } else if ((e = word(c, eol, "convoy")) || (e = word(c, eol, "convoys"))) {
+        o->kind = CONV;
+    } else {
+        return NULL;
+    }
+
+    if ((e = parse_unit(e, eol, &unit)) == NULL
+        || (e = parse_terr(e, eol, &o->t2, &coast)) == NULL) {
+        return NULL;
+    }
+
+    if ((c = word(e, eol, "->")) || (c = word(e, eol, "-"))) {
+        if (o->kind == SUPH) {
+            o->kind = SUPM;
+        }
+
+        return parse_terr(c, eol, &o->t3, &coast);
+    }
+
+    return o->kind == CONV ? NULL : e;
+}
+
+static const char *parse_phase_header(const char *c, const char *eol,
+                                      bool *movement,
+                                      enum season *season, int *year)
+{
+    const char *e;
+
+    if ((e = word(c, eol, "movement"))) {
+        *movement = true;
+    } else if ((e = word(c, eol, "retreat"))
+               || (e = word(c, eol, "adjustment"))) {
+        *movement = false;
+    } else {
+        return NULL;
+    }
+
+    if ((e = word(e, eol, "results")) == NULL
+        || (e = word(e, eol, "for")) == NULL) {
+        return NULL;
+    }
+
+    if ((c = word(e, eol, "spring"))) {
+        *season = SPRING;
+    } else if ((c = word(e, eol, "fall"))
+               || (c = word(e, eol, "autumn"))
+               || (c = word(e, eol, "winter"))) {
+        *season = AUTUMN;
+    } else {
+        return NULL;
+    }
+
+    if ((c = word(c, eol, "of")) == NULL) {
+        return NULL;
+    }
+
+    *year = 0;
+
+    while (c < eol && isdigit((unsigned char)*c)) {
+        *year = *year * 10 + (*c++ - '0');
+    }
+
+    return *year > 0 ? c : NULL;
+}
+
+/* Returns false if the line is not an order at all, true otherwise;
+ * *ok tells whether it could actually be imported */
+static bool parse_order_line(const char *c, const char *eol,
+                             struct import_phase *phase, bool *ok)
+{
+    char buf[16];
+    enum cd_terr t;
+    enum cd_coast coast;
+    enum cd_unit unit;
+
+    c = copy_word(skip_blanks(c, eol), eol, buf, sizeof buf);
+
+    if (c == NULL || c >= eol || *c != ':') {
+        return false;
+    }
+
+    enum cd_nation nat = get_nation(buf);
+    if (nat == NO_NATION) {
+        return false;
+    }
+
+    c = parse_unit(skip_blanks(c + 1, eol), eol, &unit);
+    if (c == NULL) {
+        return false;
+    }
+
+    *ok = false;
+
+    if ((c = parse_terr(c, eol, &t, &coast)) == NULL
+        || phase->units[t].occupier != NO_NATION) {
+        return true;
+    }
+
+    size_t nat_i = trail0s(nat);
+    struct order *o = &phase->orders[nat_i][phase->orders_n[nat_i]];
+    o->t1 = t;
+
+    if (parse_order(c, eol, o) == NULL) {
+        return true;
+    }
+
+    phase->units[t].occupier = nat;
+    phase->units[t].unit = unit;
+    phase->units[t].coast = coast;
+    phase->orders_n[nat_i]++;
+
+    *ok = true;
+    return true;
+}
+
+static void phase_reset(struct import_phase *phase)
+{
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        phase->units[t].occupier = NO_NATION;
+    }
+
+    memset(phase->orders_n, 0, sizeof phase->orders_n);
+}
+
+static bool phase_flush(struct import_phase *phase, import_fn fn, void *data,
+                        struct import_stats *stats)
+{
+    size_t n = 0;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        n += phase->orders_n[nat_i];
+    }
+
+    if (n == 0) {
+        return true;
+    }
+
+    stats->phases++;
+    stats->orders += n;
+
+    bool go_on = fn(phase, data);
+    phase_reset(phase);
+
+    return go_on;
+}
+
+int import_archive(const char *path, import_fn fn, void *data,
+                   struct import_stats *stats)
+{
+    memset(stats, 0, sizeof *stats);
+    resolve_names();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+
+    struct import_phase *phase = xmalloc(sizeof *phase);
+    phase_reset(phase);
+
+    const char *c = map;
+    const char *end = map + st.st_size;
+    bool movement = false;
+    bool go_on = true;
+
+    while (c < end && go_on) {
+        const char *eol = memchr(c, '\n', end - c);
+        if (eol == NULL) {
+            eol = end;
+        }
+
+        bool next_movement, ok;
+        enum season next_season;
+        int next_year;
+
+        if (c < eol && isalpha((unsigned char)*c)) {
+            if (parse_phase_header(c, eol, &next_movement,
+                                   &next_season, &next_year)) {
+                go_on = phase_flush(phase, fn, data, stats);
+                movement = next_movement;
+                phase->season = next_season;
+                phase->year = next_year;
+            } else if (movement && parse_order_line(c, eol, phase, &ok)
+                       && !ok) {
+                stats->skipped++;
+            }
+        }
+
+        c = eol + 1;
+    }
+
+    if (go_on) {
+        phase_flush(phase, fn, data, stats);
+    }
+
+    stats->bytes = st.st_size;
+
+    xfree(phase);
+    munmap((void *)map, st.st_size);
+
+    return 0;
+}
+
+void import_load(const struct import_phase *phase)
+{
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        const struct terr_info *u = &phase->units[t];
+
+        board[t].occupier = NO_NATION;
+        cd_clear_unit(t);
+        touch_terr(t);
+
+        if (u->occupier == NO_NATION
+            || cd_register_unit(t, u->coast, u->unit, u->occupier) != 0) {
+            continue;
+        }
+
+        board[t].occupier = u->occupier;
+        board[t].unit = u->unit;
+        board[t].coast = u->coast;
+    }
+
+    year = phase->year;
+    season = phase->season;
+
+    delete_all_orders();
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < phase->orders_n[nat_i]; i++) {
+            const struct order *o = &phase->orders[nat_i][i];
+
+            register_order(1u << nat_i, o->kind, o->t1, o->t2, o->t3,
+                           o->coast, o->viac);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IMPORT_H_
+#define _IMPORT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cdippy.h>
+
+#include "board.h"
+#include "game.h"
+
+/* One movement phase of an archived game. Only the fields occupier,
+ * unit and coast of units[] are meaningful */
+struct import_phase {
+    int year;
+    enum season season;
+
+    struct terr_info units[TERR_N];
+
+    size_t orders_n[NATIONS_N];
+    struct order orders[NATIONS_N][TERR_N];
+};
+
+struct import_stats {
+    size_t bytes;
+    size_t phases;
+    size_t orders;
+    size_t skipped;
+};
+
+/* Called once per movement phase, in archive order; returning false
+ * stops the import */
+typedef bool (*import_fn)(const struct import_phase *phase, void *data);
+
+int import_archive(const char *path, import_fn fn, void *data,
+                   struct import_stats *stats);
+void import_load(const struct import_phase *phase);
+
+#endif /* _IMPORT_H_ */
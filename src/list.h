@@ -20,7 +20,7 @@
 #ifndef _LIST_H_
 #define _LIST_H_
 
-#include <stdlib.h>
+#include "alloc.h"
 
 #define DEFINE_LIST(name, type)                                         \
                                                                         \
@@ -33,7 +33,7 @@ typedef struct name##list_cons *name##list_t;                           \
                                                                         \
 inline static name##list_t name##list_cons(type item)                   \
 {                                                                       \
-    name##list_t tmp = malloc(sizeof *tmp);                             \
+    name##list_t tmp = xmalloc(sizeof *tmp);                            \
     tmp->item = item;                                                   \
     tmp->next = NULL;                                                   \
     return tmp;                                                         \
@@ -50,7 +50,7 @@ inline static void name##list_free(name##list_t list)                   \
 {                                                                       \
     while (list != NULL) {                                              \
         name##list_t next = list->next;                                 \
-        free(list);                                                     \
+        xfree(list);                                                    \
         list = next;                                                    \
     }                                                                   \
 }
@@ -18,27 +18,52 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <getopt.h>
 
 #include <readline/history.h>
 
 #include "commons.h"
 #include "board.h"
 #include "game.h"
+#include "sched.h"
+#include "stats.h"
+#include "cache.h"
+#include "pprintf.h"
+#include "alloc.h"
+#include "import.h"
+#include "positions.h"
+#include "export.h"
+#include "map.h"
+#include "spectate.h"
+#include "submit.h"
 
 #include "parser.h"
 
 #define HIST_FILE ".cdippy-cli_history"
+#define HIST_MAX 1000
 
 char *hist_path;
 
+void readline_init();
+int watch_init(const char *path);
+int yylex_destroy();
+
 void save_history()
 {
+    if (!hist_path) {
+        return;
+    }
+
     int ret = write_history(hist_path);
     if (ret != 0) {
         perror("save_history");
     }
+
+    xfree(hist_path);
+    hist_path = NULL;
 }
 
 void load_history()
@@ -49,7 +74,7 @@ void load_history()
         return;
     }
 
-    hist_path = malloc(strlen(home) + strlen(HIST_FILE) + 2);
+    hist_path = xmalloc(strlen(home) + strlen(HIST_FILE) + 2);
     sprintf(hist_path, "%s/%s", home, HIST_FILE);
 
     int ret = read_history(hist_path);
@@ -58,16 +83,173 @@ void load_history()
     }
 }
 
-int main()
+/* Everything still allocated once the session is torn down is a leak */
+void check_leaks()
+{
+    save_history();
+    yylex_destroy();
+    cache_clear();
+    pprintf_release();
+    positions_close();
+    positions_set_path(NULL);
+
+    if (alloc_live() != 0) {
+        fprintf(stderr, "%zu allocations leaked\n", alloc_live());
+    }
+}
+
+bool keep_last_phase(const struct import_phase *phase, void *data)
 {
+    memcpy(data, phase, sizeof *phase);
+    return true;
+}
+
+void load_archive(const char *path)
+{
+    struct import_phase *last = xmalloc(sizeof *last);
+    struct import_stats st;
+
+    unsigned long t0 = stats_now();
+
+    if (import_archive(path, keep_last_phase, last, &st) == 0) {
+        double secs = (stats_now() - t0) / 1e9;
+
+        printf("Imported %zu phases, %zu orders (%zu skipped) from %s "
+               "in %.2fs (%.1f MB/s)\n",
+               st.phases, st.orders, st.skipped, path,
+               secs, st.bytes / 1e6 / (secs > 0 ? secs : 1));
+
+        if (st.phases > 0) {
+            import_load(last);
+            print_date();
+        }
+    }
+
+    xfree(last);
+}
+
+void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [--db FILE] [--import FILE] [--watch FILE] "
+                    "[--export DIR] [--share NAME] [--submit DIR]\n"
+                    "       %s [--db FILE] --index ARCHIVE\n", argv0, argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option options[] = {
+        {"import", required_argument, NULL, 'i'},
+        {"watch",  required_argument, NULL, 'w'},
+        {"db",     required_argument, NULL, 'd'},
+        {"index",  required_argument, NULL, 'x'},
+        {"export", required_argument, NULL, 'e'},
+        {"share",  required_argument, NULL, 's'},
+        {"submit", required_argument, NULL, 'u'},
+        {"help",   no_argument,       NULL, 'h'},
+        {NULL,     0,                 NULL, 0}
+    };
+
+    const char *import_path = NULL;
+    const char *watch_path = NULL;
+    const char *index_path = NULL;
+    const char *export_path = NULL;
+    const char *share_name = NULL;
+    const char *submit_dir = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'i':
+            import_path = optarg;
+            break;
+
+        case 'w':
+            watch_path = optarg;
+            break;
+
+        case 'd':
+            positions_set_path(optarg);
+            break;
+
+        case 'x':
+            index_path = optarg;
+            break;
+
+        case 'e':
+            export_path = optarg;
+            break;
+
+        case 's':
+            share_name = optarg;
+            break;
+
+        case 'u':
+            submit_dir = optarg;
+            break;
+
+        case 'h':
+            usage(argv[0]);
+            return 0;
+
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
     using_history();
+    stifle_history(HIST_MAX);
     load_history();
     atexit(save_history);
+    readline_init();
 
+    sched_init();
+    stats_init();
     board_init();
+    map_init();
+
+    if (index_path) {
+        bool ok = positions_open(NULL, true) == 0
+                  && positions_index(index_path) == 0;
+
+        positions_close();
+        positions_set_path(NULL);
+        return ok ? 0 : 1;
+    }
+
     game_init();
 
+    if (export_path && export_init(export_path) != 0) {
+        return 1;
+    }
+
+    if (import_path) {
+        load_archive(import_path);
+    }
+
+    if (share_name && spectate_init(share_name) != 0) {
+        return 1;
+    }
+
+    if (watch_path && watch_init(watch_path) != 0) {
+        return 1;
+    }
+
+    /* Nobody is at the prompt to choose disbands */
+    if (watch_path) {
+        set_interactive(false);
+    }
+
+    if (submit_dir && submit_listen(submit_dir) != 0) {
+        return 1;
+    }
+
     yyparse();
+    submit_close();
+    adjudication_wait();
+    export_close();
+    spectate_close();
+    check_leaks();
 
     return 0;
 }
@@ -0,0 +1,771 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "commons.h"
+#include "pprintf.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+
+/* Each line lists a territory followed by its neighbours. Fleet lines
+ * name coasts where needed, Bulgaria's east coast counting as north
+ * since cdippy only knows two. Edges are listed once and mirrored */
+
+static const char *army_lines[] = {
+    "alb gre ser tri",
+    "ank arm con smy",
+    "apu nap rom ven",
+    "arm sev smy syr",
+    "bel bur hol pic ruh",
+    "ber kie mun pru sil",
+    "boh gal mun sil tyr vie",
+    "bre gas par pic",
+    "bud gal rum ser tri vie",
+    "bul con gre rum ser",
+    "bur gas mar mun par pic ruh",
+    "cly edi lvp",
+    "con smy",
+    "den kie swe",
+    "edi lvp yor",
+    "fin nwy stp swe",
+    "gal rum sil ukr vie war",
+    "gas mar par spa",
+    "gre ser",
+    "hol kie ruh",
+    "kie mun ruh",
+    "lon wal yor",
+    "lvn mos pru stp war",
+    "lvp wal yor",
+    "mar pie spa",
+    "mos sev stp ukr war",
+    "mun ruh sil tyr",
+    "naf tun",
+    "nap rom",
+    "nwy stp swe",
+    "par pic",
+    "pie tus tyr ven",
+    "por spa",
+    "pru sil war",
+    "rom tus ven",
+    "rum ser sev ukr",
+    "ser tri",
+    "sev ukr",
+    "sil war",
+    "smy syr",
+    "tri tyr ven vie",
+    "tus ven",
+    "tyr ven vie",
+    "ukr war",
+    "wal yor"
+};
+
+static const char *fleet_lines[] = {
+    "adr alb apu ion tri ven",
+    "aeg bul/sc con eas gre ion smy",
+    "bal ber bot den kie lvn pru swe",
+    "bar nwg nwy stp/nc",
+    "bla ank arm bul/nc con rum sev",
+    "bot fin lvn stp/sc swe",
+    "eas ion smy syr",
+    "eng bel bre iri lon mao nth pic wal",
+    "hel den hol kie",
+    "ion alb apu gre nap tun tys",
+    "iri lvp mao nao wal",
+    "lyo mar pie spa/sc tus tys wes",
+    "mao bre gas naf nao por spa/nc spa/sc wes",
+    "nao cly lvp nwg",
+    "nth bel den edi hel hol lon nwg nwy ska yor",
+    "nwg cly edi nwy",
+    "ska den nwy swe",
+    "tys nap rom tun tus wes",
+    "wes naf spa/sc tun",
+    "alb gre tri",
+    "ank arm con",
+    "apu nap ven",
+    "arm sev",
+    "bel hol pic",
+    "ber kie pru",
+    "bre gas pic",
+    "bul/nc con rum",
+    "bul/sc con gre",
+    "cly edi lvp",
+    "con smy",
+    "den kie swe",
+    "edi yor",
+    "fin stp/sc swe",
+    "gas spa/nc",
+    "hol kie",
+    "lon wal yor",
+    "lvn pru stp/sc",
+    "lvp wal",
+    "mar pie spa/sc",
+    "naf tun",
+    "nap rom",
+    "nwy stp/nc swe",
+    "pie tus",
+    "por spa/nc spa/sc",
+    "rom tus",
+    "rum sev",
+    "smy syr",
+    "tri ven"
+};
+
+/* Other spellings of the abbreviations above */
+static const char *aliases[][3] = {
+    {"bot", "gob"},
+    {"eas", "emed"},
+    {"eng", "ech"},
+    {"lvn", "lvo", "liv"},
+    {"lvp", "lpl"},
+    {"lyo", "gol"},
+    {"mao", "mid"},
+    {"nao", "nat"},
+    {"nth", "nts"},
+    {"nwg", "nrg"},
+    {"nwy", "nor"},
+    {"tys", "tyn"},
+    {"wes", "wmed"}
+};
+
+struct adjacency army_adj[TERR_N];
+struct adjacency fleet_adj[TERR_N][3];
+
+/* Territories reachable by a move, and therefore supportable, by an army
+ * or a fleet on each coast, regardless of the destination coast */
+static struct terrset move_sets[TERR_N][2][3];
+static struct terrset sea_set;
+static struct terrset coastal_set;
+
+/* Bit i set for every territory bordering the i-th group of seas
+ * connected to each other (the Black Sea is a group of its own) */
+static unsigned sea_groups[TERR_N];
+
+/* Fleet moves split by the coast they land on, for reachability */
+static struct terrset fleet_moves[TERR_N][3][3];
+
+/* Territories reachable within k moves, filled in on first use; the map
+ * never changes so entries stay valid */
+static struct {
+    bool done;
+    struct terrset set;
+} reach_cache[TERR_N][2][3][REACH_MAX + 1];
+
+size_t coast_index(enum cd_coast coast)
+{
+    return coast == NORTH ? 1 : coast == SOUTH ? 2 : 0;
+}
+
+static enum cd_terr resolve(const char *abbr)
+{
+    int t = get_terr(abbr);
+
+    size_t i, j;
+    for (i = 0; t == NO_TERR && i < ARRSIZE(aliases); i++) {
+        if (istrcmp(aliases[i][0], abbr) != 0) {
+            continue;
+        }
+
+        for (j = 1; t == NO_TERR && j < 3 && aliases[i][j] != NULL; j++) {
+            t = get_terr(aliases[i][j]);
+        }
+    }
+
+    assert(t != NO_TERR);
+    return t;
+}
+
+static struct terr_coast parse_tc(char *tok)
+{
+    struct terr_coast tc = {NO_TERR, NO_COAST};
+    char *slash = strchr(tok, '/');
+
+    if (slash != NULL) {
+        *slash = '\0';
+        tc.coast = slash[1] == 'n' ? NORTH : SOUTH;
+    }
+
+    tc.terr = resolve(tok);
+    return tc;
+}
+
+static void add_edge(struct adjacency *adj, struct terr_coast to)
+{
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        if (adj->to[i].terr == to.terr && adj->to[i].coast == to.coast) {
+            return;
+        }
+    }
+
+    assert(adj->n < ADJ_MAX);
+    adj->to[adj->n++] = to;
+}
+
+static void load_lines(const char *lines[], size_t n, bool fleet)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        char buf[64];
+        snprintf(buf, sizeof buf, "%s", lines[i]);
+
+        struct terr_coast from = parse_tc(strtok(buf, " "));
+
+        char *tok;
+        while ((tok = strtok(NULL, " ")) != NULL) {
+            struct terr_coast to = parse_tc(tok);
+
+            if (fleet) {
+                add_edge(&fleet_adj[from.terr][coast_index(from.coast)], to);
+                add_edge(&fleet_adj[to.terr][coast_index(to.coast)], from);
+            } else {
+                to.coast = from.coast = NO_COAST;
+                add_edge(&army_adj[from.terr], to);
+                add_edge(&army_adj[to.terr], from);
+            }
+        }
+    }
+}
+
+static void group_seas()
+{
+    enum cd_terr queue[TERR_N];
+    unsigned group = 0;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (!terrset_has(&sea_set, t) || sea_groups[t] != 0) {
+            continue;
+        }
+
+        assert(group < sizeof group * CHAR_BIT);
+
+        size_t head = 0, tail = 0;
+        queue[tail++] = t;
+        sea_groups[t] = 1u << group;
+
+        while (head < tail) {
+            const struct adjacency *adj = &fleet_adj[queue[head++]][0];
+
+            size_t i;
+            for (i = 0; i < adj->n; i++) {
+                enum cd_terr s = adj->to[i].terr;
+
+                if (sea_groups[s] & 1u << group) {
+                    continue;
+                }
+
+                sea_groups[s] |= 1u << group;
+
+                if (terrset_has(&sea_set, s)) {
+                    queue[tail++] = s;
+                }
+            }
+        }
+
+        group++;
+    }
+}
+
+void map_init()
+{
+    static bool done = false;
+
+    if (done) {
+        return;
+    }
+
+    load_lines(army_lines, ARRSIZE(army_lines), false);
+    load_lines(fleet_lines, ARRSIZE(fleet_lines), true);
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        size_t i, c;
+        for (i = 0; i < army_adj[t].n; i++) {
+            terrset_add(&move_sets[t][0][0], army_adj[t].to[i].terr);
+        }
+
+        for (c = 0; c < 3; c++) {
+            for (i = 0; i < fleet_adj[t][c].n; i++) {
+                struct terr_coast to = fleet_adj[t][c].to[i];
+
+                terrset_add(&move_sets[t][1][c], to.terr);
+                terrset_add(&fleet_moves[t][c][coast_index(to.coast)],
+                            to.terr);
+            }
+        }
+
+        if (army_adj[t].n == 0) {
+            terrset_add(&sea_set, t);
+        } else if (fleet_adj[t][0].n > 0 || fleet_adj[t][1].n > 0) {
+            terrset_add(&coastal_set, t);
+        }
+    }
+
+    group_seas();
+
+    done = true;
+}
+
+const struct adjacency *map_adjacency(enum cd_terr t, enum cd_unit unit,
+                                      enum cd_coast coast)
+{
+    if (unit == ARMY) {
+        return &army_adj[t];
+    }
+
+    return &fleet_adj[t][coast_index(coast)];
+}
+
+const struct terrset *map_moves(enum cd_terr t, enum cd_unit unit,
+                                enum cd_coast coast)
+{
+    if (unit == ARMY) {
+        return &move_sets[t][0][0];
+    }
+
+    return &move_sets[t][1][coast_index(coast)];
+}
+
+bool map_adjacent(enum cd_terr t1, enum cd_unit unit, enum cd_coast coast,
+                  enum cd_terr t2)
+{
+    return terrset_has(map_moves(t1, unit, coast), t2);
+}
+
+/* Like map_adjacent(), but a fleet must also reach the destination coast
+ * when one is given */
+bool map_can_move(enum cd_terr t1, enum cd_unit unit, enum cd_coast coast,
+                  enum cd_terr t2, enum cd_coast coast2)
+{
+    if (!map_adjacent(t1, unit, coast, t2)) {
+        return false;
+    }
+
+    if (unit == ARMY || coast2 == NO_COAST) {
+        return coast2 == NO_COAST;
+    }
+
+    const struct adjacency *adj = map_adjacency(t1, unit, coast);
+
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        if (adj->to[i].terr == t2 && adj->to[i].coast == coast2) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Some chain of seas must join the two coasts */
+bool map_can_convoy(enum cd_terr t1, enum cd_terr t2)
+{
+    return t1 != t2 && is_coastal(t1) && is_coastal(t2)
+           && (sea_groups[t1] & sea_groups[t2]) != 0;
+}
+
+bool is_sea(enum cd_terr t)
+{
+    return terrset_has(&sea_set, t);
+}
+
+bool has_coasts(enum cd_terr t)
+{
+    return fleet_adj[t][1].n > 0;
+}
+
+bool is_coastal(enum cd_terr t)
+{
+    return terrset_has(&coastal_set, t);
+}
+
+/* Seas holding a fleet that are connected to t through other such seas */
+static void fleet_seas(enum cd_terr t, struct terrset *seas)
+{
+    enum cd_terr queue[TERR_N];
+    size_t head = 0, tail = 0;
+
+    memset(seas, 0, sizeof *seas);
+
+    if (is_sea(t)) {
+        terrset_add(seas, t);
+        queue[tail++] = t;
+    } else {
+        size_t c;
+        for (c = 0; c < 3; c++) {
+            const struct adjacency *adj = &fleet_adj[t][c];
+
+            size_t i;
+            for (i = 0; i < adj->n; i++) {
+                enum cd_terr s = adj->to[i].terr;
+
+                if (is_sea(s) && board[s].occupier != NO_NATION
+                    && !terrset_has(seas, s)) {
+                    terrset_add(seas, s);
+                    queue[tail++] = s;
+                }
+            }
+        }
+    }
+
+    while (head < tail) {
+        const struct adjacency *adj = &fleet_adj[queue[head++]][0];
+
+        size_t i;
+        for (i = 0; i < adj->n; i++) {
+            enum cd_terr s = adj->to[i].terr;
+
+            if (is_sea(s) && board[s].occupier != NO_NATION
+                && !terrset_has(seas, s)) {
+                terrset_add(seas, s);
+                queue[tail++] = s;
+            }
+        }
+    }
+}
+
+static bool touches(enum cd_terr t, const struct terrset *seas)
+{
+    size_t w;
+    for (w = 0; w < TERRSET_WORDS; w++) {
+        uint64_t m = move_sets[t][1][0].w[w]
+                   | move_sets[t][1][1].w[w]
+                   | move_sets[t][1][2].w[w];
+
+        if (m & seas->w[w]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void add_legal(struct order out[], size_t *n, size_t max,
+                      enum order_kind kind, enum cd_terr t1, enum cd_terr t2,
+                      enum cd_terr t3, enum cd_coast coast, bool viac)
+{
+    if ((*n)++ >= max) {
+        return;
+    }
+
+    struct order *o = &out[*n - 1];
+
+    o->kind  = kind;
+    o->t1    = t1;
+    o->t2    = t2;
+    o->t3    = t3;
+    o->coast = coast;
+    o->viac  = viac;
+}
+
+/* Convoys are only listed along chains of seas currently holding fleets.
+ * Like snprintf(), returns how many orders there are even past max */
+size_t legal_orders(enum cd_terr t, struct order out[], size_t max)
+{
+    const struct terr_info *ti = &board[t];
+    size_t n = 0;
+
+    if (ti->occupier == NO_NATION) {
+        return 0;
+    }
+
+    add_legal(out, &n, max, HOLD, t, NO_TERR, NO_TERR, NO_COAST, false);
+
+    const struct adjacency *adj = map_adjacency(t, ti->unit, ti->coast);
+
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        add_legal(out, &n, max, MOVE, t, t, adj->to[i].terr,
+                  ti->unit == FLEET ? adj->to[i].coast : NO_COAST, false);
+    }
+
+    struct terrset seas;
+
+    if (ti->unit == ARMY && is_coastal(t)) {
+        fleet_seas(t, &seas);
+
+        enum cd_terr to;
+        for (to = 0; to < TERR_N; to++) {
+            if (map_can_convoy(t, to) && touches(to, &seas)) {
+                add_legal(out, &n, max, MOVE, t, t, to, NO_COAST, true);
+            }
+        }
+    }
+
+    const struct terrset *moves = map_moves(t, ti->unit, ti->coast);
+
+    enum cd_terr other;
+    for (other = 0; other < TERR_N; other++) {
+        const struct terr_info *oi = &board[other];
+
+        if (other == t || oi->occupier == NO_NATION) {
+            continue;
+        }
+
+        if (terrset_has(moves, other)) {
+            add_legal(out, &n, max, SUPH, t, other, NO_TERR, NO_COAST, false);
+        }
+
+        const struct terrset *reach = map_moves(other, oi->unit, oi->coast);
+
+        size_t w;
+        for (w = 0; w < TERRSET_WORDS; w++) {
+            uint64_t m = moves->w[w] & reach->w[w];
+
+            while (m != 0) {
+                enum cd_terr to = w * 64 + trail0s(m);
+                m &= m - 1;
+
+                add_legal(out, &n, max, SUPM, t, other, to, NO_COAST, false);
+            }
+        }
+    }
+
+    if (ti->unit == FLEET && is_sea(t)) {
+        fleet_seas(t, &seas);
+
+        for (other = 0; other < TERR_N; other++) {
+            if (board[other].occupier == NO_NATION
+                || board[other].unit != ARMY
+                || !is_coastal(other)
+                || !touches(other, &seas)) {
+                continue;
+            }
+
+            enum cd_terr to;
+            for (to = 0; to < TERR_N; to++) {
+                if (map_can_convoy(other, to) && touches(to, &seas)) {
+                    add_legal(out, &n, max, CONV, t, other, to,
+                              NO_COAST, false);
+                }
+            }
+        }
+    }
+
+    return n;
+}
+
+void print_legal(enum cd_terr t)
+{
+    map_init();
+
+    static struct order orders[LEGAL_MAX];
+    size_t n = legal_orders(t, orders, LEGAL_MAX);
+
+    if (n == 0) {
+        printf("No unit in %s\n", get_terr_name(t));
+        return;
+    }
+
+    pprintf_init();
+
+    pprintf("%zu legal orders for %s %s\n", n,
+            get_unit_name(board[t].unit), get_terr_name(t));
+
+    size_t i;
+    for (i = 0; i < n && i < LEGAL_MAX; i++) {
+        pprint_order(&orders[i]);
+        pputchar('\n');
+    }
+
+    if (n > LEGAL_MAX) {
+        pprintf("... %zu more not shown\n", n - LEGAL_MAX);
+    }
+
+    pputchar('\n');
+}
+
+/* Breadth-first expansion of a frontier of (territory, coast) bitsets;
+ * every intermediate depth is cached along the way */
+const struct terrset *map_reach(enum cd_terr t, enum cd_unit unit,
+                                enum cd_coast coast, unsigned k)
+{
+    size_t u = unit == FLEET;
+    size_t ci = u ? coast_index(coast) : 0;
+
+    if (k > REACH_MAX) {
+        k = REACH_MAX;
+    }
+
+    if (reach_cache[t][u][ci][k].done) {
+        return &reach_cache[t][u][ci][k].set;
+    }
+
+    struct terrset seen[3], frontier[3];
+    memset(seen, 0, sizeof seen);
+    memset(frontier, 0, sizeof frontier);
+
+    terrset_add(&seen[ci], t);
+    terrset_add(&frontier[ci], t);
+
+    unsigned step;
+    for (step = 1; step <= k; step++) {
+        struct terrset next[3];
+        memset(next, 0, sizeof next);
+
+        size_t c, w;
+        for (c = 0; c < 3; c++) {
+            for (w = 0; w < TERRSET_WORDS; w++) {
+                uint64_t m = frontier[c].w[w];
+
+                while (m != 0) {
+                    enum cd_terr from = w * 64 + trail0s(m);
+                    m &= m - 1;
+
+                    size_t dc, x;
+                    for (dc = 0; dc < 3; dc++) {
+                        const struct terrset *moves = u
+                            ? &fleet_moves[from][c][dc]
+                            : dc == 0 ? &move_sets[from][0][0] : NULL;
+
+                        for (x = 0; moves != NULL && x < TERRSET_WORDS; x++) {
+                            next[dc].w[x] |= moves->w[x];
+                        }
+                    }
+                }
+            }
+        }
+
+        struct terrset *r = &reach_cache[t][u][ci][step].set;
+        memset(r, 0, sizeof *r);
+
+        for (c = 0; c < 3; c++) {
+            for (w = 0; w < TERRSET_WORDS; w++) {
+                frontier[c].w[w] = next[c].w[w] & ~seen[c].w[w];
+                seen[c].w[w] |= next[c].w[w];
+                r->w[w] |= seen[c].w[w];
+            }
+        }
+
+        r->w[t / 64] &= ~(1ull << (t % 64));
+        reach_cache[t][u][ci][step].done = true;
+    }
+
+    return &reach_cache[t][u][ci][k].set;
+}
+
+static void print_terrset(const struct terrset *s)
+{
+    bool any = false;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (terrset_has(s, t)) {
+            pprintf(" %s", get_terr_name(t));
+            any = true;
+        }
+    }
+
+    pprintf(any ? "\n" : " nothing\n");
+}
+
+/* Fewest moves from the nearest territory in from[], which ends with
+ * NO_TERR, passing through land and sea alike as civil disorder
+ * distances do */
+void map_distances(const enum cd_terr from[], unsigned dist[])
+{
+    enum cd_terr queue[TERR_N];
+    size_t head = 0, tail = 0;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        dist[t] = UINT_MAX;
+    }
+
+    size_t i;
+    for (i = 0; from[i] != NO_TERR; i++) {
+        dist[from[i]] = 0;
+        queue[tail++] = from[i];
+    }
+
+    while (head < tail) {
+        enum cd_terr t = queue[head++];
+
+        size_t c;
+        for (c = 0; c < 4; c++) {
+            const struct adjacency *adj = c == 3 ? &army_adj[t]
+                                                 : &fleet_adj[t][c];
+
+            for (i = 0; i < adj->n; i++) {
+                enum cd_terr to = adj->to[i].terr;
+
+                if (dist[to] == UINT_MAX) {
+                    dist[to] = dist[t] + 1;
+                    queue[tail++] = to;
+                }
+            }
+        }
+    }
+}
+
+void print_reach(enum cd_terr t, unsigned k)
+{
+    map_init();
+
+    if (k == 0 || k > REACH_MAX) {
+        printf("Number of phases must be between 1 and %u\n", REACH_MAX);
+        return;
+    }
+
+    const struct terr_info *ti = &board[t];
+
+    if (ti->occupier == NO_NATION && !ti->supp_center) {
+        printf("No unit in %s\n", get_terr_name(t));
+        return;
+    }
+
+    pprintf_init();
+
+    if (ti->occupier != NO_NATION) {
+        pprintf("%s %s%s reaches in %u phase%s:", get_unit_name(ti->unit),
+                get_terr_name(t), get_coast_name(ti->coast),
+                k, k == 1 ? "" : "s");
+        print_terrset(map_reach(t, ti->unit, ti->coast, k));
+    }
+
+    if (!ti->supp_center) {
+        return;
+    }
+
+    pprintf("Units threatening %s in %u phase%s:",
+            get_terr_name(t), k, k == 1 ? "" : "s");
+
+    bool any = false;
+
+    enum cd_terr other;
+    for (other = 0; other < TERR_N; other++) {
+        const struct terr_info *oi = &board[other];
+
+        if (other == t || oi->occupier == NO_NATION
+            || oi->occupier == ti->owner
+            || !terrset_has(map_reach(other, oi->unit, oi->coast, k), t)) {
+            continue;
+        }
+
+        pprintf(" %s %s", get_unit_name(oi->unit), get_terr_name(other));
+        any = true;
+    }
+
+    pprintf(any ? "\n" : " none\n");
+}
@@ -0,0 +1,88 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MAP_H_
+#define _MAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cdippy.h>
+
+#include "board.h"
+#include "game.h"
+
+#define ADJ_MAX 12
+#define LEGAL_MAX 512
+#define REACH_MAX 16
+
+#define TERRSET_WORDS ((TERR_N + 63) / 64)
+
+struct terrset {
+    uint64_t w[TERRSET_WORDS];
+};
+
+static inline bool terrset_has(const struct terrset *s, enum cd_terr t)
+{
+    return s->w[t / 64] >> (t % 64) & 1;
+}
+
+static inline void terrset_add(struct terrset *s, enum cd_terr t)
+{
+    s->w[t / 64] |= 1ull << (t % 64);
+}
+
+/* Standard map adjacencies, as seen by an army, or by a fleet on each
+ * coast of a territory (index 0 no coast, 1 north, 2 south) */
+struct adjacency {
+    size_t n;
+    struct terr_coast to[ADJ_MAX];
+};
+
+extern struct adjacency army_adj[TERR_N];
+extern struct adjacency fleet_adj[TERR_N][3];
+
+void map_init();
+
+size_t coast_index(enum cd_coast coast);
+const struct adjacency *map_adjacency(enum cd_terr t, enum cd_unit unit,
+                                      enum cd_coast coast);
+bool map_adjacent(enum cd_terr t1, enum cd_unit unit, enum cd_coast coast,
+                  enum cd_terr t2);
+const struct terrset *map_moves(enum cd_terr t, enum cd_unit unit,
+                                enum cd_coast coast);
+bool map_can_move(enum cd_terr t1, enum cd_unit unit, enum cd_coast coast,
+                  enum cd_terr t2, enum cd_coast coast2);
+bool map_can_convoy(enum cd_terr t1, enum cd_terr t2);
+
+bool is_sea(enum cd_terr t);
+bool is_coastal(enum cd_terr t);
+bool has_coasts(enum cd_terr t);
+
+size_t legal_orders(enum cd_terr t, struct order out[], size_t max);
+void print_legal(enum cd_terr t);
+
+const struct terrset *map_reach(enum cd_terr t, enum cd_unit unit,
+                                enum cd_coast coast, unsigned k);
+void print_reach(enum cd_terr t, unsigned k);
+
+void map_distances(const enum cd_terr from[], unsigned dist[]);
+
+#endif /* _MAP_H_ */
@@ -31,6 +31,15 @@
 #include "commons.h"
 #include "game.h"
 #include "board.h"
+#include "cache.h"
+#include "stats.h"
+#include "probes.h"
+#include "positions.h"
+#include "rollout.h"
+#include "suggest.h"
+#include "explain.h"
+#include "map.h"
+#include "targets.h"
 
 void yyerror(const char *s);
 int yywrap();
@@ -41,6 +50,10 @@ void range_error(unsigned a, unsigned b);
 
 %}
 
+%code requires {
+#include <stdint.h>
+}
+
 %union {
     int i;
     unsigned u;
@@ -51,23 +64,46 @@ void range_error(unsigned a, unsigned b);
     terrlist_t tlist;
     char *s;
     bool b;
+    uint64_t h;
 }
 
 %token ALL
+%token ANALYZE
+%token AUTODIFF
 %token BOARD
 %token BUILD
 %token BY
 %token C
+%token CACHE
 %token CLEAR
+%token CONFLICTS
+%token DEADLINE
 %token DELETE
+%token DEPTH
+%token DIFF
+%token EXPLAIN
+%token FAIL
+%token FIND
 %token LIST
 %token H
+%token INTO
+%token LEGAL
+%token OFF
+%token ON
+%token ORDERS
 %token OWNER
 %token PHASE
+%token POSITIONS
+%token PREVIEW
+%token REACH
 %token RESET
+%token ROLLOUTS
 %token RUN
 %token S
 %token SET
+%token STATS
+%token SUGGEST
+%token VERIFY
 %token VIA
 %token YEAR
 
@@ -77,8 +113,10 @@ void range_error(unsigned a, unsigned b);
 %token <i> UNIT
 %token <i> ERA
 %token <i> SEASON
+%token <i> STATE
 
 %token <u> NUM
+%token <h> HASH
 
 %token <s> UNRECOGNIZED
 
@@ -94,38 +132,64 @@ void range_error(unsigned a, unsigned b);
 %type <tlist> tlist
 
 %type <b> viac
+%type <b> onoff
 
 %start commands
 
 %destructor { tclist_free($$); } <tclist>
 %destructor { terrlist_free($$); } <tlist>
 %destructor { rangelist_free($$); } <rlist>
-%destructor { free($$); } <s>
+%destructor { xfree($$); } <s>
 
 %%
 
 commands: /* Nothing */
-        | commands command '\n'
-        | commands error '\n' { yyerrok; }
+        | commands command '\n' {
+    PROBE(command__done);
+    stats_stop(&command_timer, STAGE_COMMAND);
+    stats_start(&command_timer);
+}
+        | commands error '\n' { PROBE(command__error); yyerrok; }
 
-command: set
-       | order
-       | delete
-       | clear
+command: idle set
+       | idle order
+       | idle delete
+       | idle clear
        | list
-       | NATION { cur_nat = $1; }
-       | BOARD  { print_board(); }
-       | RESET  { board_init(); }
-       | RUN    { adjudicate(); }
+       | idle NATION  { cur_nat = $2; }
+       | BOARD        { print_board(); }
+       | BOARD DIFF   { print_board_diff(); }
+       | DEADLINE     { print_deadline(); }
+       | idle CACHE   { print_cache_stats(); }
+       | idle STATS   { print_stats(); }
+       | POSITIONS    { positions_current(); }
+       | POSITIONS FIND HASH { positions_find($3); }
+       | LEGAL TERR   { print_legal($2); }
+       | REACH TERR   { print_reach($2, 1); }
+       | REACH TERR NUM { print_reach($2, $3); }
+       | CONFLICTS    { print_conflicts(); }
+       | ORDERS '-' INTO TERR { print_orders_into($4); }
+       | idle RESET   { board_init(); }
+       | idle RUN     { adjudicate(); }
+       | idle PREVIEW { preview(); }
+       | idle ANALYZE ROLLOUTS NUM DEPTH NUM { analyze_rollouts($4, $6); }
+       | idle SUGGEST NATION { suggest($3); }
+       | idle EXPLAIN '-' FAIL NUM { explain_fail($5); }
+
+idle: /* Nothing */ { adjudication_wait(); }
 
 set: SET tclist UNIT NATION { set_terrs($2, $3, $4); tclist_free($2); }
    | SET OWNER tlist NATION { set_centers($3, $4); terrlist_free($3); }
    | SET YEAR year era      { year = ((int)$3) * $4; }
    | SET PHASE SEASON       { season = $3; }
+   | SET DEADLINE STATE NUM { set_deadline($3, $4); }
+   | SET VERIFY onoff       { set_verify($3); }
+   | SET AUTODIFF onoff     { set_autodiff($3); }
 
 clear: CLEAR tlist       { clear_terrs($2); terrlist_free($2); }
      | CLEAR OWNER tlist { clear_centers($3); terrlist_free($3); }
      | CLEAR ALL         { clear_all(); }
+     | CLEAR DEADLINE    { clear_deadlines(); }
 
 list: LIST NATION { list_orders($2); }
     | LIST ALL    { list_all_orders(); }
@@ -164,6 +228,9 @@ range: NUM '-' NUM {
 tlist: TERR       { $$ = terrlist_cons($1); }
      | tlist TERR { $$ = terrlist_add($1, $2); }
 
+onoff: ON  { $$ = true; }
+     | OFF { $$ = false; }
+
 viac: VIA C         { $$ = true; }
     | BY C          { $$ = true; }
     | C             { $$ = true; }
@@ -174,7 +241,7 @@ order: tlist H                  { order_hold($1); terrlist_free($1); }
      | tlist S TERR             { order_suph($1, $3); terrlist_free($1); }
      | tlist S TERR '-' TERR    { order_supm($1, $3, $5); terrlist_free($1); }
      | tlist C TERR '-' TERR    { order_conv($1, $3, $5); terrlist_free($1); }
-     | BUILD UNIT tclist        { order_build($3, $2); }
+     | BUILD UNIT tclist        { order_build($3, $2); tclist_free($3); }
 
 %%
 
@@ -185,20 +252,42 @@ const char *tokenstr(int token)
         const char *name;
     } keywords[] = {
         {ALL,    "all"},
+        {ANALYZE, "analyze"},
+        {AUTODIFF, "autodiff"},
         {BOARD,  "board"},
         {BUILD,  "build"},
         {BY,     "by"},
         {C,      "c"},
+        {CACHE,  "cache"},
         {CLEAR,  "clear"},
+        {CONFLICTS, "conflicts"},
+        {DEADLINE, "deadline"},
         {DELETE, "delete"},
+        {DEPTH,  "depth"},
+        {DIFF,   "diff"},
+        {EXPLAIN, "explain"},
+        {FAIL,   "fail"},
+        {FIND,   "find"},
         {H,      "h"},
+        {INTO,   "into"},
+        {LEGAL,  "legal"},
+        {OFF,    "off"},
+        {ON,     "on"},
+        {ORDERS, "orders"},
         {OWNER,  "owner"},
         {LIST,   "list"},
         {PHASE,  "phase"},
+        {POSITIONS, "positions"},
+        {PREVIEW, "preview"},
+        {REACH,  "reach"},
         {RESET,  "reset"},
+        {ROLLOUTS, "rollouts"},
         {RUN,    "run"},
         {S,      "s"},
         {SET,    "set"},
+        {STATS,  "stats"},
+        {SUGGEST, "suggest"},
+        {VERIFY, "verify"},
         {VIA,    "via"},
         {YEAR,   "year"},
     };
@@ -220,6 +309,9 @@ const char *tokenstr(int token)
     case SEASON:
         return get_season_name(yylval.i);
 
+    case STATE:
+        return get_state_name(yylval.i);
+
     case COAST:
         return get_coast_name(yylval.i);
 
@@ -0,0 +1,659 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "cache.h"
+#include "pprintf.h"
+#include "import.h"
+#include "positions.h"
+#include "stats.h"
+
+#define INDEX_MAGIC "CDPIDX1"
+#define INDEX_INITIAL (1u << 16)
+#define SHOW_MAX 10
+
+struct index_header {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t records;
+    uint64_t games;
+};
+
+/* Offsets into the data file are stored plus one, so that 0 can mark
+ * empty slots and chain ends */
+struct index_slot {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t seen;
+};
+
+static char *db_path = NULL;
+static bool db_writable;
+
+static int data_fd = -1;
+static FILE *data_out = NULL;
+static uint64_t data_end;
+static const char *data_map = NULL;
+static size_t data_size;
+
+static int index_fd = -1;
+static struct index_header *index_map = NULL;
+static size_t index_size;
+
+static struct index_slot *index_slots()
+{
+    return (struct index_slot *)(index_map + 1);
+}
+
+static size_t index_bytes(uint64_t capacity)
+{
+    return sizeof (struct index_header)
+         + capacity * sizeof (struct index_slot);
+}
+
+static size_t record_size(const struct position_record *r)
+{
+    size_t size = sizeof *r + r->orders_n * sizeof (struct packed_order);
+
+    return (size + 7) & ~(size_t)7;
+}
+
+const char *positions_path()
+{
+    if (db_path == NULL) {
+        char *home = getenv("HOME");
+
+        db_path = xmalloc((home ? strlen(home) : 1)
+                          + strlen(POSITIONS_FILE) + 2);
+        sprintf(db_path, "%s/%s", home ? home : ".", POSITIONS_FILE);
+    }
+
+    return db_path;
+}
+
+void positions_set_path(const char *path)
+{
+    xfree(db_path);
+    db_path = path ? xstrdup(path) : NULL;
+}
+
+static struct index_slot *index_slot(uint64_t hash)
+{
+    struct index_slot *slots = index_slots();
+    uint64_t mask = index_map->capacity - 1;
+
+    uint64_t i = hash & mask;
+    while (slots[i].offset != 0 && slots[i].hash != hash) {
+        i = (i + 1) & mask;
+    }
+
+    return &slots[i];
+}
+
+/* Rehashes into a table of the given capacity, which must be a power
+ * of two, growing the file underneath */
+static int index_resize(uint64_t capacity)
+{
+    struct index_slot *old = NULL;
+    uint64_t old_capacity = 0;
+    struct index_header header;
+
+    memset(&header, 0, sizeof header);
+
+    if (index_map != NULL) {
+        old_capacity = index_map->capacity;
+        header = *index_map;
+
+        old = xmalloc(old_capacity * sizeof *old);
+        memcpy(old, index_slots(), old_capacity * sizeof *old);
+
+        munmap(index_map, index_size);
+        index_map = NULL;
+    }
+
+    index_size = index_bytes(capacity);
+
+    if (ftruncate(index_fd, index_size) != 0) {
+        perror("positions");
+        xfree(old);
+        return -1;
+    }
+
+    index_map = mmap(NULL, index_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     index_fd, 0);
+
+    if (index_map == MAP_FAILED) {
+        perror("positions");
+        index_map = NULL;
+        xfree(old);
+        return -1;
+    }
+
+    memset(index_map, 0, index_size);
+    memcpy(index_map->magic, INDEX_MAGIC, sizeof index_map->magic);
+    index_map->capacity = capacity;
+    index_map->count = header.count;
+    index_map->records = header.records;
+    index_map->games = header.games;
+
+    uint64_t i;
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].offset != 0) {
+            *index_slot(old[i].hash) = old[i];
+        }
+    }
+
+    xfree(old);
+    return 0;
+}
+
+static int map_data()
+{
+    struct stat st;
+
+    if (fstat(data_fd, &st) != 0) {
+        perror(positions_path());
+        return -1;
+    }
+
+    if (data_map != NULL) {
+        if ((size_t)st.st_size == data_size) {
+            return 0;
+        }
+
+        munmap((void *)data_map, data_size);
+        data_map = NULL;
+    }
+
+    data_size = st.st_size;
+
+    if (data_size == 0) {
+        return 0;
+    }
+
+    data_map = mmap(NULL, data_size, PROT_READ, MAP_SHARED, data_fd, 0);
+
+    if (data_map == MAP_FAILED) {
+        perror(positions_path());
+        data_map = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void positions_close()
+{
+    if (data_out != NULL) {
+        fclose(data_out);
+        data_out = NULL;
+        data_fd = -1;
+    }
+
+    if (data_map != NULL) {
+        munmap((void *)data_map, data_size);
+        data_map = NULL;
+    }
+
+    if (index_map != NULL) {
+        munmap(index_map, index_size);
+        index_map = NULL;
+    }
+
+    if (data_fd >= 0) {
+        close(data_fd);
+        data_fd = -1;
+    }
+
+    if (index_fd >= 0) {
+        close(index_fd);
+        index_fd = -1;
+    }
+}
+
+int positions_open(const char *path, bool writable)
+{
+    positions_close();
+
+    if (path != NULL) {
+        positions_set_path(path);
+    }
+
+    path = positions_path();
+
+    char *index_path = xmalloc(strlen(path) + 5);
+    sprintf(index_path, "%s.idx", path);
+
+    int flags = writable ? O_RDWR | O_CREAT : O_RDONLY;
+
+    data_fd = open(path, flags | O_CLOEXEC, 0644);
+    index_fd = open(index_path, flags | O_CLOEXEC, 0644);
+
+    if (data_fd < 0 || index_fd < 0) {
+        perror(data_fd < 0 ? path : index_path);
+        xfree(index_path);
+        positions_close();
+        return -1;
+    }
+
+    xfree(index_path);
+    db_writable = writable;
+
+    struct stat st;
+    if (fstat(index_fd, &st) != 0) {
+        perror(path);
+        positions_close();
+        return -1;
+    }
+
+    if (st.st_size == 0 && writable) {
+        if (index_resize(INDEX_INITIAL) != 0) {
+            positions_close();
+            return -1;
+        }
+    } else {
+        index_size = st.st_size;
+        index_map = mmap(NULL, index_size,
+                         writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                         MAP_SHARED, index_fd, 0);
+
+        if (index_map == MAP_FAILED
+            || index_size < sizeof *index_map
+            || memcmp(index_map->magic, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0
+            || !IS_POW2(index_map->capacity)
+            || index_map->capacity > (index_size - sizeof *index_map)
+                                     / sizeof (struct index_slot)
+            || index_size != index_bytes(index_map->capacity)
+            || index_map->count >= index_map->capacity) {
+
+            printf("%s: not a position index\n", path);
+
+            if (index_map == MAP_FAILED) {
+                index_map = NULL;
+            }
+
+            positions_close();
+            return -1;
+        }
+    }
+
+    if (writable) {
+        data_end = lseek(data_fd, 0, SEEK_END);
+        data_out = fdopen(data_fd, "a");
+        setvbuf(data_out, NULL, _IOFBF, 1 << 20);
+        return 0;
+    }
+
+    return map_data();
+}
+
+/* The reader may be left behind by a concurrent --index run */
+static int positions_refresh()
+{
+    if (index_map == NULL) {
+        return positions_open(NULL, false);
+    }
+
+    if (db_writable) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(index_fd, &st) != 0 || (size_t)st.st_size != index_size) {
+        return positions_open(NULL, false);
+    }
+
+    return map_data();
+}
+
+static uint8_t pack_coast(enum cd_coast coast)
+{
+    return coast == NORTH ? 1 : coast == SOUTH ? 2 : 0;
+}
+
+static enum cd_coast unpack_coast(uint8_t c)
+{
+    return c == 1 ? NORTH : c == 2 ? SOUTH : NO_COAST;
+}
+
+static uint8_t pack_square(enum cd_nation nat, enum cd_unit unit,
+                           enum cd_coast coast)
+{
+    if (nat == NO_NATION) {
+        return 0;
+    }
+
+    return (trail0s(nat) + 1)
+         | (unit == FLEET ? SQ_FLEET : 0)
+         | pack_coast(coast) << 4;
+}
+
+static uint8_t pack_terr(enum cd_terr t)
+{
+    return t == NO_TERR ? UINT8_MAX : t;
+}
+
+static enum cd_terr unpack_terr(uint8_t t)
+{
+    return t == UINT8_MAX ? NO_TERR : t;
+}
+
+uint64_t position_hash(const struct position_record *r)
+{
+    uint8_t buf[2 * TERR_N + 1];
+
+    memcpy(buf, r->squares, TERR_N);
+    memcpy(buf + TERR_N, r->owners, TERR_N);
+    buf[2 * TERR_N] = r->season;
+
+    return hash_bytes(buf, sizeof buf);
+}
+
+void pack_board(struct position_record *r)
+{
+    memset(r, 0, sizeof *r);
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        r->squares[t] = pack_square(board[t].occupier,
+                                    board[t].unit,
+                                    board[t].coast);
+
+        if (board[t].supp_center && board[t].owner != NO_NATION) {
+            r->owners[t] = trail0s(board[t].owner) + 1;
+        }
+    }
+
+    r->year = year;
+    r->season = season;
+    r->hash = position_hash(r);
+}
+
+static int positions_add(struct position_record *r,
+                         const struct packed_order *orders)
+{
+    if ((index_map->count + 1) * 2 > index_map->capacity
+        && index_resize(index_map->capacity * 2) != 0) {
+        return -1;
+    }
+
+    struct index_slot *slot = index_slot(r->hash);
+    r->prev = slot->offset;
+
+    static const char zeros[8];
+    size_t body = sizeof *r + r->orders_n * sizeof *orders;
+    size_t size = record_size(r);
+
+    if (fwrite(r, sizeof *r, 1, data_out) != 1
+        || fwrite(orders, sizeof *orders, r->orders_n, data_out)
+           != r->orders_n
+        || fwrite(zeros, 1, size - body, data_out) != size - body) {
+
+        perror(positions_path());
+        return -1;
+    }
+
+    if (slot->offset == 0) {
+        slot->hash = r->hash;
+        index_map->count++;
+    }
+
+    slot->offset = data_end + 1;
+    slot->seen++;
+    index_map->records++;
+    data_end += size;
+
+    return 0;
+}
+
+struct index_ctx {
+    uint8_t owners[TERR_N];
+    int year;
+    enum season season;
+    bool started;
+    bool failed;
+};
+
+static void reset_owners(uint8_t owners[TERR_N])
+{
+    memset(owners, 0, TERR_N);
+
+    size_t i, j;
+    for (i = 0; i < NATIONS_N; i++) {
+        for (j = 0; home_centers[i][j] != NO_TERR; j++) {
+            owners[home_centers[i][j]] = i + 1;
+        }
+    }
+}
+
+/* Archives only list orders, so ownership is replayed: a game starts
+ * from the home centers whenever the calendar goes backwards, and
+ * centers change hands as they are found occupied at the start of a
+ * spring phase, i.e. once autumn retreats are over */
+static bool index_phase(const struct import_phase *phase, void *data)
+{
+    struct index_ctx *ctx = data;
+
+    if (!ctx->started || phase->year < ctx->year
+        || (phase->year == ctx->year && phase->season <= ctx->season)) {
+
+        reset_owners(ctx->owners);
+        index_map->games++;
+        ctx->started = true;
+    }
+
+    ctx->year = phase->year;
+    ctx->season = phase->season;
+
+    struct position_record r;
+    struct packed_order orders[TERR_N];
+
+    memset(&r, 0, sizeof r);
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        const struct terr_info *u = &phase->units[t];
+
+        r.squares[t] = pack_square(u->occupier, u->unit, u->coast);
+
+        if (phase->season == SPRING && board[t].supp_center
+            && u->occupier != NO_NATION) {
+
+            ctx->owners[t] = trail0s(u->occupier) + 1;
+        }
+    }
+
+    memcpy(r.owners, ctx->owners, TERR_N);
+    r.game = index_map->games - 1;
+    r.year = phase->year;
+    r.season = phase->season;
+    r.hash = position_hash(&r);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < phase->orders_n[nat_i]; i++) {
+            const struct order *o = &phase->orders[nat_i][i];
+            struct packed_order *p = &orders[r.orders_n++];
+
+            p->nation = nat_i;
+            p->kind = o->kind;
+            p->t1 = pack_terr(o->t1);
+            p->t2 = pack_terr(o->t2);
+            p->t3 = pack_terr(o->t3);
+            p->coast = pack_coast(o->coast) | (o->viac ? PACKED_VIAC : 0);
+        }
+    }
+
+    if (positions_add(&r, orders) != 0) {
+        ctx->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+int positions_index(const char *archive)
+{
+    struct index_ctx ctx;
+    struct import_stats st;
+
+    memset(&ctx, 0, sizeof ctx);
+
+    if (index_map == NULL || !db_writable) {
+        puts("Position database not open for writing");
+        return -1;
+    }
+
+    uint64_t games = index_map->games;
+    unsigned long t0 = stats_now();
+
+    if (import_archive(archive, index_phase, &ctx, &st) != 0 || ctx.failed) {
+        return -1;
+    }
+
+    fflush(data_out);
+
+    printf("Indexed %zu positions from %llu games in %.2fs "
+           "(%llu positions total)\n",
+           st.phases, (unsigned long long)(index_map->games - games),
+           (stats_now() - t0) / 1e9,
+           (unsigned long long)index_map->records);
+
+    return 0;
+}
+
+static bool valid_terr(uint8_t t)
+{
+    return t < TERR_N || t == UINT8_MAX;
+}
+
+static bool valid_packed(const struct packed_order *p)
+{
+    return p->nation < NATIONS_N && p->kind <= CONV
+           && valid_terr(p->t1) && valid_terr(p->t2) && valid_terr(p->t3);
+}
+
+static void print_record(const struct position_record *r)
+{
+    pprintf("%016llx: %d %s, game %lu\n",
+            (unsigned long long)r->hash, r->year,
+            get_season_name(r->season), (unsigned long)r->game);
+
+    const struct packed_order *orders = (const void *)(r + 1);
+
+    size_t i;
+    for (i = 0; i < r->orders_n; i++) {
+        const struct packed_order *p = &orders[i];
+
+        if (!valid_packed(p)) {
+            pprintf("    (invalid order)\n");
+            continue;
+        }
+
+        struct order o = {
+            .kind  = p->kind,
+            .t1    = unpack_terr(p->t1),
+            .t2    = unpack_terr(p->t2),
+            .t3    = unpack_terr(p->t3),
+            .coast = unpack_coast(p->coast & ~PACKED_VIAC),
+            .viac  = p->coast & PACKED_VIAC
+        };
+
+        pprintf("    %-8s ", get_nation_name(1u << p->nation));
+        pprint_order(&o);
+        pputchar('\n');
+    }
+
+    /* Phases of a game are indexed back to back */
+    uint64_t next = (const char *)r - data_map + record_size(r);
+
+    if (next + sizeof *r <= data_size) {
+        const struct position_record *n = (const void *)(data_map + next);
+
+        if (n->game == r->game) {
+            pprintf("    next: %016llx (%d %s)\n",
+                    (unsigned long long)n->hash, n->year,
+                    get_season_name(n->season));
+        }
+    }
+}
+
+void positions_find(uint64_t hash)
+{
+    if (positions_refresh() != 0) {
+        return;
+    }
+
+    if (data_map == NULL) {
+        puts("Position database is empty");
+        return;
+    }
+
+    pprintf_init();
+
+    const struct index_slot *slot = index_slot(hash);
+    uint64_t offset = slot->offset;
+    size_t shown = 0;
+
+    /* Latest first; records only ever link to earlier ones */
+    while (offset != 0 && shown < SHOW_MAX
+           && offset - 1 + sizeof (struct position_record) <= data_size) {
+
+        const struct position_record *r = (const void *)
+                                          (data_map + offset - 1);
+
+        /* The database may have been cut short by a crash or a copy */
+        if (offset - 1 + record_size(r) > data_size) {
+            pprintf("%016llx: record truncated\n",
+                    (unsigned long long)r->hash);
+            break;
+        }
+
+        print_record(r);
+        shown++;
+
+        offset = r->prev;
+    }
+
+    if (slot->seen == 0) {
+        pprintf("Position %016llx not seen\n", (unsigned long long)hash);
+    } else {
+        pprintf("Seen %llu time%s\n", (unsigned long long)slot->seen,
+                slot->seen == 1 ? "" : "s");
+    }
+}
+
+void positions_current()
+{
+    struct position_record r;
+    pack_board(&r);
+
+    positions_find(r.hash);
+}
@@ -0,0 +1,79 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POSITIONS_H_
+#define _POSITIONS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cdippy.h>
+
+#include "game.h"
+#include "import.h"
+
+/* Position database: an append-only file of phase records, plus a
+ * memory-mapped open-addressing table (FILE.idx) from each position
+ * hash to the latest record with that hash, which in turn links to the
+ * previous one. The hash covers units, center ownership and season but
+ * not the year, so transpositions across years and games meet */
+
+#define POSITIONS_FILE ".cdippy-cli_positions"
+
+/* Packed squares: bits 0-2 occupier (nation index + 1, 0 if empty),
+ * bit 3 fleet, bits 4-5 coast (0 none, 1 north, 2 south) */
+#define SQ_NATION(sq) ((sq) & 7)
+#define SQ_FLEET 0x08
+#define SQ_COAST(sq) (((sq) >> 4) & 3)
+
+struct position_record {
+    uint64_t hash;
+    uint64_t prev;
+    uint32_t game;
+    int16_t year;
+    uint8_t season;
+    uint8_t orders_n;
+    uint8_t squares[TERR_N];
+    uint8_t owners[TERR_N];
+};
+
+struct packed_order {
+    uint8_t nation;
+    uint8_t kind;
+    uint8_t t1;
+    uint8_t t2;
+    uint8_t t3;
+    uint8_t coast;
+};
+
+#define PACKED_VIAC 0x80
+
+const char *positions_path();
+void positions_set_path(const char *path);
+int positions_open(const char *path, bool writable);
+void positions_close();
+
+uint64_t position_hash(const struct position_record *r);
+void pack_board(struct position_record *r);
+
+int positions_index(const char *archive);
+void positions_find(uint64_t hash);
+void positions_current();
+
+#endif /* _POSITIONS_H_ */
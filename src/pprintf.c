@@ -26,18 +26,30 @@
 #include <stdarg.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "pprintf.h"
+#include "alloc.h"
 
 static unsigned short pprintf_h;
 static unsigned short pprintf_w;
 static unsigned short pprintf_r;
 static unsigned short pprintf_c;
 
+/* Reused across calls and only ever grown */
+static char *pprintf_buf = NULL;
+static size_t pprintf_size = 0;
+
 void pprintf_init()
 {
     struct winsize ws;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws);
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0
+        || ws.ws_row == 0 || ws.ws_col == 0) {
+
+        ws.ws_row = USHRT_MAX;
+        ws.ws_col = USHRT_MAX;
+    }
 
     pprintf_h = ws.ws_row;
     pprintf_w = ws.ws_col;
@@ -70,21 +82,17 @@ static void pprintf_block()
     pprintf_init();
 }
 
-int pprintf(const char *format, ...)
+static void pprintf_reserve(size_t size)
 {
-    va_list ap;
-
-    va_start(ap, format);
-    int len = vsnprintf(NULL, 0, format, ap);
-    va_end(ap);
-
-    char *buf = malloc((len + 1) * sizeof *buf);
-
-    va_start(ap, format);
-    vsprintf(buf, format, ap);
-    va_end(ap);
+    if (size > pprintf_size) {
+        pprintf_size = size;
+        pprintf_buf = xrealloc(pprintf_buf, pprintf_size);
+    }
+}
 
-    char *line = buf;
+static int pprintf_flush(int len)
+{
+    char *line = pprintf_buf;
     char *end;
 
     do {
@@ -124,11 +132,44 @@ int pprintf(const char *format, ...)
         line = end + 1;
     } while (end != NULL);
 
-    free(buf);
-
     return len;
 }
 
+int pprintf(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    int len = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+
+    pprintf_reserve((size_t)len + 1);
+
+    va_start(ap, format);
+    vsprintf(pprintf_buf, format, ap);
+    va_end(ap);
+
+    return pprintf_flush(len);
+}
+
+/* Pages already rendered text without going through vsprintf */
+int pputs(const char *s, size_t len)
+{
+    pprintf_reserve(len + 1);
+
+    memcpy(pprintf_buf, s, len);
+    pprintf_buf[len] = '\0';
+
+    return pprintf_flush((int)len);
+}
+
+void pprintf_release()
+{
+    xfree(pprintf_buf);
+    pprintf_buf = NULL;
+    pprintf_size = 0;
+}
+
 int pputchar(int c)
 {
     if (c == '\0') {
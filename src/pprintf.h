@@ -20,10 +20,14 @@
 #ifndef _PPRINTF_H_
 #define _PPRINTF_H_
 
+#include <stddef.h>
+
 #define PPRINTF_PROMPT "--MORE--"
 
 void pprintf_init();
 int pprintf(const char *format, ...);
+int pputs(const char *s, size_t len);
 int pputchar(int c);
+void pprintf_release();
 
 #endif /* _PPRINTF_H_ */
@@ -0,0 +1,50 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PROBES_H_
+#define _PROBES_H_
+
+/* Static USDT probes under the `cdippy' provider. With systemtap's
+ * <sys/sdt.h> each probe compiles to a single nop plus an ELF note,
+ * e.g. `bpftrace -e "usdt:./cdippy-cli:cdippy:adjudicate__done {...}"'.
+ * Without it they vanish entirely */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(cdippy, name)
+#define PROBE1(name, a) DTRACE_PROBE1(cdippy, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(cdippy, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(cdippy, name, a, b, c)
+
+#else
+
+#define PROBE(name) do { } while (0)
+#define PROBE1(name, a) do { } while (0)
+#define PROBE2(name, a, b) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+
+#endif
+
+#endif /* _PROBES_H_ */
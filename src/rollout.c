@@ -0,0 +1,555 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "eval.h"
+#include "workers.h"
+#include "rollout.h"
+
+#define ROLLOUTS_MAX 1000000
+#define DEPTH_MAX 100
+
+/* Continuations are played by every nation at once with a weighted
+ * random policy: units lean towards supply centers they do not own,
+ * and idle units support a neighbouring friendly move when they can */
+#define W_HOLD 2
+#define W_MOVE 2
+#define W_CENTER 6
+#define W_OWN 1
+
+struct sim {
+    struct terr_info board[TERR_N];
+    int year;
+    enum season season;
+};
+
+struct rollout_totals {
+    unsigned long runs;
+    unsigned long centers[NATIONS_N];
+    unsigned long eliminated[NATIONS_N];
+    unsigned long solos[NATIONS_N];
+    long scores[NATIONS_N];
+};
+
+struct rollout_job {
+    struct sim start;
+    unsigned n;
+    unsigned depth;
+    uint64_t seed;
+    struct rollout_totals totals;
+};
+
+static uint64_t rng;
+
+static uint64_t next_random()
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+
+    return rng * 0x2545f4914f6cdd1dull;
+}
+
+static unsigned pick(unsigned n)
+{
+    return next_random() % n;
+}
+
+static enum cd_coast retreat_coast(const struct terr_info *ti, unsigned coasts)
+{
+    if (ti->unit == ARMY) {
+        return NO_COAST;
+    }
+
+    if (coasts & NORTH) {
+        return coasts & SOUTH && pick(2) ? SOUTH : NORTH;
+    }
+
+    return coasts & SOUTH ? SOUTH : NO_COAST;
+}
+
+static void choose_move(const struct sim *s, enum cd_terr t,
+                        struct order *o)
+{
+    const struct terr_info *ti = &s->board[t];
+    const struct adjacency *adj = map_adjacency(t, ti->unit, ti->coast);
+
+    unsigned weights[ADJ_MAX];
+    unsigned total = W_HOLD;
+
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        const struct terr_info *to = &s->board[adj->to[i].terr];
+
+        if (to->occupier == ti->occupier) {
+            weights[i] = W_OWN;
+        } else if (to->supp_center && to->owner != ti->occupier) {
+            weights[i] = W_MOVE + W_CENTER;
+        } else {
+            weights[i] = W_MOVE;
+        }
+
+        total += weights[i];
+    }
+
+    o->kind = HOLD;
+    o->t1 = o->t2 = t;
+    o->t3 = NO_TERR;
+    o->coast = NO_COAST;
+    o->viac = false;
+
+    unsigned r = pick(total);
+    if (r < W_HOLD) {
+        return;
+    }
+
+    r -= W_HOLD;
+
+    for (i = 0; i < adj->n; i++) {
+        if (r < weights[i]) {
+            o->kind = MOVE;
+            o->t3 = adj->to[i].terr;
+            o->coast = ti->unit == FLEET ? adj->to[i].coast : NO_COAST;
+            return;
+        }
+
+        r -= weights[i];
+    }
+}
+
+static void choose_support(const struct sim *s, struct order *o,
+                           const struct order orders[], size_t n)
+{
+    const struct terr_info *ti = &s->board[o->t1];
+
+    size_t candidates[TERR_N];
+    size_t candidates_n = 0;
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        const struct order *other = &orders[i];
+        enum cd_terr target = other->kind == MOVE ? other->t3 : other->t1;
+
+        if (other == o
+            || s->board[other->t1].occupier != ti->occupier
+            || target == o->t1
+            || !map_adjacent(o->t1, ti->unit, ti->coast, target)) {
+            continue;
+        }
+
+        candidates[candidates_n++] = i;
+    }
+
+    if (candidates_n == 0) {
+        return;
+    }
+
+    const struct order *other = &orders[candidates[pick(candidates_n)]];
+
+    if (other->kind == MOVE) {
+        o->kind = SUPM;
+        o->t2 = other->t1;
+        o->t3 = other->t3;
+    } else {
+        o->kind = SUPH;
+        o->t2 = other->t1;
+    }
+}
+
+static void play_movement(struct sim *s)
+{
+    struct order orders[TERR_N];
+    size_t n = 0;
+
+    size_t t;
+    for (t = 0; t < TERR_N; t++) {
+        if (s->board[t].occupier != NO_NATION) {
+            choose_move(s, t, &orders[n++]);
+        }
+    }
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (orders[i].kind == HOLD && pick(2)) {
+            choose_support(s, &orders[i], orders, n);
+        }
+    }
+
+    register_units_with_adjudicator(s->board);
+
+    struct order *registered[TERR_N];
+    size_t registered_n = 0;
+
+    for (i = 0; i < n; i++) {
+        if (register_order_with_adjudicator(&orders[i])) {
+            registered[registered_n++] = &orders[i];
+        }
+    }
+
+    cd_run_adjudicator();
+
+    struct terr_info moving[TERR_N];
+    struct order *moves[TERR_N];
+    size_t moves_n = 0;
+
+    for (i = 0; i < registered_n; i++) {
+        if (registered[i]->kind == MOVE && cd_resolutions[i] == SUCCEEDS) {
+            moves[moves_n++] = registered[i];
+        }
+    }
+
+    struct terr_info dislodged_units[TERR_N];
+    enum cd_terr retreat_to[TERR_N];
+    enum cd_coast retreat_coasts[TERR_N];
+    unsigned contenders[TERR_N];
+
+    memset(contenders, 0, sizeof contenders);
+
+    for (i = 0; i < cd_retreats_n; i++) {
+        const struct cd_retreat *r = &cd_retreats[i];
+
+        dislodged_units[i] = s->board[r->who];
+        retreat_to[i] = NO_TERR;
+
+        if (r->where_n == 0) {
+            continue;
+        }
+
+        const struct cd_where *w = &r->where[pick(r->where_n)];
+
+        retreat_to[i] = w->terr;
+        retreat_coasts[i] = retreat_coast(&dislodged_units[i], w->coasts);
+        contenders[w->terr]++;
+    }
+
+    for (i = 0; i < moves_n; i++) {
+        moving[i] = s->board[moves[i]->t1];
+        s->board[moves[i]->t1].occupier = NO_NATION;
+    }
+
+    for (i = 0; i < moves_n; i++) {
+        struct terr_info *to = &s->board[moves[i]->t3];
+
+        to->occupier = moving[i].occupier;
+        to->unit = moving[i].unit;
+        to->coast = moves[i]->coast;
+    }
+
+    for (i = 0; i < cd_retreats_n; i++) {
+        enum cd_terr t = retreat_to[i];
+
+        if (t == NO_TERR || contenders[t] > 1) {
+            continue;
+        }
+
+        s->board[t].occupier = dislodged_units[i].occupier;
+        s->board[t].unit = dislodged_units[i].unit;
+        s->board[t].coast = retreat_coasts[i];
+    }
+}
+
+static void count_sim(const struct sim *s,
+                      unsigned units_n[], unsigned centers_n[])
+{
+    memset(units_n, 0, NATIONS_N * sizeof units_n[0]);
+    memset(centers_n, 0, NATIONS_N * sizeof centers_n[0]);
+
+    size_t t;
+    for (t = 0; t < TERR_N; t++) {
+        const struct terr_info *ti = &s->board[t];
+
+        if (ti->occupier != NO_NATION) {
+            units_n[trail0s(ti->occupier)]++;
+        }
+
+        if (ti->supp_center && ti->owner != NO_NATION) {
+            centers_n[trail0s(ti->owner)]++;
+        }
+    }
+}
+
+static void disband_random(struct sim *s, enum cd_nation nat, unsigned n)
+{
+    while (n > 0) {
+        enum cd_terr owned[TERR_N];
+        size_t owned_n = 0;
+
+        size_t t;
+        for (t = 0; t < TERR_N; t++) {
+            if (s->board[t].occupier == nat) {
+                owned[owned_n++] = t;
+            }
+        }
+
+        if (owned_n == 0) {
+            return;
+        }
+
+        s->board[owned[pick(owned_n)]].occupier = NO_NATION;
+        n--;
+    }
+}
+
+static void build_random(struct sim *s, size_t nat_i, unsigned n)
+{
+    enum cd_nation nat = 1u << nat_i;
+
+    size_t i;
+    for (i = 0; n > 0 && home_centers[nat_i][i] != NO_TERR; i++) {
+        enum cd_terr t = home_centers[nat_i][i];
+        struct terr_info *ti = &s->board[t];
+
+        if (ti->owner != nat || ti->occupier != NO_NATION) {
+            continue;
+        }
+
+        ti->occupier = nat;
+        ti->unit = ARMY;
+        ti->coast = NO_COAST;
+
+        if (is_coastal(t) && pick(3) == 0) {
+            ti->unit = FLEET;
+
+            if (has_coasts(t)) {
+                ti->coast = pick(2) ? NORTH : SOUTH;
+            }
+        }
+
+        n--;
+    }
+}
+
+/* Returns false once somebody reached a solo victory */
+static bool play_adjustments(struct sim *s)
+{
+    size_t t;
+    for (t = 0; t < TERR_N; t++) {
+        struct terr_info *ti = &s->board[t];
+
+        if (ti->supp_center && ti->occupier != NO_NATION) {
+            ti->owner = ti->occupier;
+        }
+    }
+
+    unsigned units_n[NATIONS_N];
+    unsigned centers_n[NATIONS_N];
+
+    count_sim(s, units_n, centers_n);
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        enum cd_nation nat = 1u << nat_i;
+
+        if (centers_n[nat_i] >= GOAL) {
+            return false;
+        }
+
+        if (units_n[nat_i] > centers_n[nat_i]) {
+            disband_random(s, nat, units_n[nat_i] - centers_n[nat_i]);
+        } else if (units_n[nat_i] < centers_n[nat_i]) {
+            build_random(s, nat_i, centers_n[nat_i] - units_n[nat_i]);
+        }
+    }
+
+    return true;
+}
+
+static void play_rollout(struct sim *s, unsigned depth,
+                         struct rollout_totals *totals)
+{
+    unsigned i;
+    for (i = 0; i < depth; i++) {
+        play_movement(s);
+
+        if (s->season == SPRING) {
+            s->season = AUTUMN;
+            continue;
+        }
+
+        s->season = SPRING;
+        s->year++;
+
+        if (!play_adjustments(s)) {
+            break;
+        }
+    }
+
+    unsigned units_n[NATIONS_N];
+    unsigned centers_n[NATIONS_N];
+
+    count_sim(s, units_n, centers_n);
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        totals->centers[nat_i] += centers_n[nat_i];
+
+        if (units_n[nat_i] == 0 && centers_n[nat_i] == 0) {
+            totals->eliminated[nat_i]++;
+        } else if (centers_n[nat_i] >= GOAL) {
+            totals->solos[nat_i]++;
+        }
+    }
+
+    totals->runs++;
+}
+
+static void add_scores(struct eval_batch *batch,
+                       struct rollout_totals *totals)
+{
+    static int16_t scores[NATIONS_N][EVAL_BATCH];
+
+    eval_run(batch, scores);
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < batch->n; i++) {
+            totals->scores[nat_i] += scores[nat_i][i];
+        }
+    }
+
+    eval_clear(batch);
+}
+
+static void rollouts_work(size_t w, size_t n, int fd, void *data)
+{
+    const struct rollout_job *job = data;
+
+    static struct eval_batch batch;
+    eval_clear(&batch);
+
+    struct rollout_totals totals;
+    memset(&totals, 0, sizeof totals);
+
+    rng = job->seed ^ (0x9e3779b97f4a7c15ull * (w + 1));
+    if (rng == 0) {
+        rng = 1;
+    }
+
+    unsigned i;
+    for (i = w; i < job->n; i += n) {
+        struct sim s = job->start;
+        play_rollout(&s, job->depth, &totals);
+
+        eval_add(&batch, s.board);
+        if (batch.n == EVAL_BATCH) {
+            add_scores(&batch, &totals);
+        }
+    }
+
+    add_scores(&batch, &totals);
+
+    write_full(fd, &totals, sizeof totals);
+}
+
+static bool rollouts_collect(size_t w, int fd, void *data)
+{
+    (void)w;
+
+    struct rollout_job *job = data;
+    struct rollout_totals part;
+
+    if (!read_full(fd, &part, sizeof part)) {
+        return false;
+    }
+
+    job->totals.runs += part.runs;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        job->totals.centers[nat_i]    += part.centers[nat_i];
+        job->totals.eliminated[nat_i] += part.eliminated[nat_i];
+        job->totals.solos[nat_i]      += part.solos[nat_i];
+        job->totals.scores[nat_i]     += part.scores[nat_i];
+    }
+
+    return true;
+}
+
+static void print_rollouts(const struct rollout_job *job)
+{
+    const struct rollout_totals *totals = &job->totals;
+    double runs = totals->runs;
+
+    printf("\n%lu rollouts, %u phases deep\n\n", totals->runs, job->depth);
+    printf("%-10s %8s %11s %7s %7s\n",
+           "", "centers", "eliminated", "solo", "score");
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        printf("%-10s %8.2f %10.1f%% %6.1f%% %7.1f\n",
+               get_nation_name(1u << nat_i),
+               totals->centers[nat_i] / runs,
+               100.0 * totals->eliminated[nat_i] / runs,
+               100.0 * totals->solos[nat_i] / runs,
+               totals->scores[nat_i] / runs);
+    }
+
+    putchar('\n');
+}
+
+void analyze_rollouts(unsigned n, unsigned depth)
+{
+    if (!awaiting_orders()) {
+        puts("Rollouts can only start from a main phase");
+        return;
+    }
+
+    if (n == 0 || n > ROLLOUTS_MAX) {
+        printf("Number of rollouts must be between 1 and %u\n", ROLLOUTS_MAX);
+        return;
+    }
+
+    if (depth == 0 || depth > DEPTH_MAX) {
+        printf("Depth must be between 1 and %u phases\n", DEPTH_MAX);
+        return;
+    }
+
+    eval_init();
+
+    static struct rollout_job job;
+
+    memcpy(job.start.board, board, sizeof board);
+    job.start.year = year;
+    job.start.season = season;
+    job.n = n;
+    job.depth = depth;
+    job.seed = (uint64_t)time(NULL) << 20 ^ (uint64_t)getpid();
+    memset(&job.totals, 0, sizeof job.totals);
+
+    size_t workers = workers_n() < n ? workers_n() : n;
+
+    if (!run_workers(workers, rollouts_work, rollouts_collect, &job)) {
+        puts("Rollouts failed");
+        return;
+    }
+
+    print_rollouts(&job);
+}
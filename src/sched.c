@@ -0,0 +1,154 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include "sched.h"
+
+static struct timer wheel[WHEEL_SIZE];
+static struct timer pending;
+static unsigned long cur_tick;
+
+static unsigned long now_ticks()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * (1000 / TICK_MS)
+         + (unsigned long)ts.tv_nsec / (TICK_MS * 1000000ul);
+}
+
+static void list_init(struct timer *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void list_insert(struct timer *head, struct timer *t)
+{
+    t->next = head->next;
+    t->prev = head;
+    head->next->prev = t;
+    head->next = t;
+}
+
+static void list_remove(struct timer *t)
+{
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+void sched_init()
+{
+    size_t i;
+    for (i = 0; i < WHEEL_SIZE; i++) {
+        list_init(&wheel[i]);
+    }
+
+    list_init(&pending);
+    cur_tick = now_ticks();
+}
+
+void timer_arm(struct timer *t, unsigned long ms)
+{
+    timer_disarm(t);
+
+    t->expires = now_ticks() + (ms + TICK_MS - 1) / TICK_MS;
+    t->armed = true;
+
+    if (t->expires <= cur_tick) {
+        list_insert(&pending, t);
+    } else {
+        list_insert(&wheel[t->expires % WHEEL_SIZE], t);
+    }
+}
+
+void timer_disarm(struct timer *t)
+{
+    if (!t->armed) {
+        return;
+    }
+
+    list_remove(t);
+    t->armed = false;
+}
+
+unsigned long timer_remaining(const struct timer *t)
+{
+    if (!t->armed) {
+        return 0;
+    }
+
+    unsigned long now = now_ticks();
+
+    return t->expires > now ? (t->expires - now) * TICK_MS : 0;
+}
+
+size_t sched_tick()
+{
+    unsigned long now = now_ticks();
+    unsigned long steps = now - cur_tick;
+
+    if (steps > WHEEL_SIZE) {
+        steps = WHEEL_SIZE;
+    }
+
+    unsigned long i;
+    for (i = 0; i < steps; i++) {
+        struct timer *head = &wheel[(now - i) % WHEEL_SIZE];
+        struct timer *t = head->next;
+
+        while (t != head) {
+            struct timer *next = t->next;
+
+            if (t->expires <= now) {
+                list_remove(t);
+                list_insert(&pending, t);
+            }
+
+            t = next;
+        }
+    }
+
+    cur_tick = now;
+
+    size_t n = 0;
+    struct timer *t;
+    for (t = pending.next; t != &pending; t = t->next) {
+        n++;
+    }
+
+    return n;
+}
+
+void sched_run()
+{
+    sched_tick();
+
+    while (pending.next != &pending) {
+        struct timer *t = pending.next;
+
+        list_remove(t);
+        t->armed = false;
+
+        t->callback(t->data);
+    }
+}
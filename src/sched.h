@@ -0,0 +1,53 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Hashed timer wheel: timers are kept in one of WHEEL_SIZE slots by
+ * expiry tick, and every tick only its own slot is scanned. Ticks are
+ * derived from the monotonic clock, never accumulated, so deadlines do
+ * not drift however late the wheel is serviced. */
+
+#define TICK_MS 100
+#define WHEEL_SIZE 256
+
+struct timer {
+    unsigned long expires;
+    void (*callback)(void *data);
+    void *data;
+
+    struct timer *next;
+    struct timer *prev;
+    bool armed;
+};
+
+void sched_init();
+
+void timer_arm(struct timer *t, unsigned long ms);
+void timer_disarm(struct timer *t);
+unsigned long timer_remaining(const struct timer *t);
+
+size_t sched_tick();
+void sched_run();
+
+#endif /* _SCHED_H_ */
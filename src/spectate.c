@@ -0,0 +1,162 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "alloc.h"
+#include "board.h"
+#include "game.h"
+#include "spectate.h"
+
+static char *shm_name = NULL;
+static struct spectate_view *view = NULL;
+
+/* Orders are kept here between adjudication and the next publication */
+static struct spectate_order pending[SPECTATE_ORDERS_MAX];
+static size_t pending_n = 0;
+
+static uint8_t pack_nation(enum cd_nation nat)
+{
+    return nat == NO_NATION ? 0 : trail0s(nat) + 1;
+}
+
+int spectate_init(const char *name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof *view) != 0) {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    view = mmap(NULL, sizeof *view, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (view == MAP_FAILED) {
+        perror("mmap");
+        view = NULL;
+        return -1;
+    }
+
+    memset(view, 0, sizeof *view);
+    memcpy(view->magic, SPECTATE_MAGIC, sizeof view->magic);
+
+    shm_name = xstrdup(name);
+
+    /* Sessions always start in a main phase, imported or not */
+    spectate_publish(get_state("main"), 0);
+
+    return 0;
+}
+
+void spectate_resolution(const struct order orders[][TERR_N],
+                         const size_t orders_n[],
+                         const enum outcome outcomes[][TERR_N])
+{
+    if (view == NULL) {
+        return;
+    }
+
+    pending_n = 0;
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < orders_n[nat_i]; i++) {
+            const struct order *o = &orders[nat_i][i];
+            struct spectate_order *p = &pending[pending_n++];
+
+            p->nation  = nat_i + 1;
+            p->kind    = o->kind;
+            p->t1      = o->t1;
+            p->t2      = o->t2 == NO_TERR ? 0xff : o->t2;
+            p->t3      = o->t3 == NO_TERR ? 0xff : o->t3;
+            p->coast   = o->coast;
+            p->viac    = o->viac;
+            p->outcome = outcomes[nat_i][i];
+        }
+    }
+}
+
+void spectate_publish(int state, size_t dislodged_n)
+{
+    if (view == NULL) {
+        return;
+    }
+
+    unsigned seq = atomic_load_explicit(&view->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&view->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    view->year = year;
+    view->season = season;
+    view->state = state;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        struct spectate_square *sq = &view->squares[t];
+
+        sq->occupier = pack_nation(board[t].occupier);
+        sq->owner    = board[t].supp_center ? pack_nation(board[t].owner) : 0;
+        sq->unit     = sq->occupier != 0 ? board[t].unit : 0;
+        sq->coast    = sq->occupier != 0 ? board[t].coast : 0;
+    }
+
+    view->orders_n = pending_n;
+    memcpy(view->orders, pending, pending_n * sizeof pending[0]);
+
+    view->dislodged_n = dislodged_n;
+
+    size_t i;
+    for (i = 0; i < dislodged_n; i++) {
+        view->dislodged[i] = cd_retreats[i].who;
+    }
+
+    atomic_store_explicit(&view->seq, seq + 2, memory_order_release);
+}
+
+void spectate_close()
+{
+    if (view == NULL) {
+        return;
+    }
+
+    munmap(view, sizeof *view);
+    view = NULL;
+
+    shm_unlink(shm_name);
+    xfree(shm_name);
+    shm_name = NULL;
+}
@@ -0,0 +1,97 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SPECTATE_H_
+#define _SPECTATE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include <cdippy.h>
+
+#include "game.h"
+
+/* Read-only view of the game published in POSIX shared memory. The
+ * writer bumps seq to an odd value before updating and back to an even
+ * one after, so readers retry until they see the same even value on
+ * both sides of their copy. Nations are stored as index plus one, 0
+ * meaning none; territories, units and coasts as cdippy values. */
+
+#define SPECTATE_MAGIC "CDPSHM1"
+#define SPECTATE_ORDERS_MAX (NATIONS_N * TERR_N)
+
+struct spectate_square {
+    uint8_t unit;
+    uint8_t coast;
+    uint8_t occupier;
+    uint8_t owner;
+};
+
+struct spectate_order {
+    uint8_t nation;
+    uint8_t kind;
+    uint8_t t1;
+    uint8_t t2;
+    uint8_t t3;
+    uint8_t coast;
+    uint8_t viac;
+    uint8_t outcome;
+};
+
+struct spectate_view {
+    char magic[8];
+    atomic_uint seq;
+
+    int32_t year;
+    uint8_t season;
+    uint8_t state;
+    uint8_t pad[2];
+
+    struct spectate_square squares[TERR_N];
+
+    /* Orders of the last adjudicated main phase and the units dislodged */
+    uint32_t orders_n;
+    uint32_t dislodged_n;
+    struct spectate_order orders[SPECTATE_ORDERS_MAX];
+    uint8_t dislodged[TERR_N];
+};
+
+static inline void spectate_read(const struct spectate_view *v,
+                                 struct spectate_view *out)
+{
+    unsigned s1, s2;
+
+    do {
+        s1 = atomic_load_explicit(&v->seq, memory_order_acquire);
+        memcpy(out, v, sizeof *out);
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&v->seq, memory_order_relaxed);
+    } while (s1 != s2 || s1 % 2 != 0);
+}
+
+int spectate_init(const char *name);
+void spectate_resolution(const struct order orders[][TERR_N],
+                         const size_t orders_n[],
+                         const enum outcome outcomes[][TERR_N]);
+void spectate_publish(int state, size_t dislodged_n);
+void spectate_close();
+
+#endif /* _SPECTATE_H_ */
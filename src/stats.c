@@ -0,0 +1,234 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "commons.h"
+#include "stats.h"
+#include "cache.h"
+#include "alloc.h"
+
+/* HDR-style histograms: one bucket row per power of two, each split in
+ * 2^SUB_BITS linear sub-buckets, so every recorded latency is kept with
+ * a relative error below 2^-SUB_BITS at a fixed memory cost */
+
+#define SUB_BITS 4
+#define SUB_N (1u << SUB_BITS)
+#define ROWS_N (64 - SUB_BITS + 1)
+
+/* Recorded by whichever thread runs a stage, the adjudication worker
+ * included, and read by the game thread: counters are relaxed atomics,
+ * and printing works on a copy */
+struct histogram {
+    _Atomic uint64_t buckets[ROWS_N][SUB_N];
+    _Atomic uint64_t total;
+    _Atomic uint64_t max;
+};
+
+struct hist_copy {
+    uint64_t buckets[ROWS_N][SUB_N];
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+};
+
+static const char *stage_names[] = {
+    "lex",
+    "command",
+    "register_order",
+    "registration",
+    "adjudicator",
+    "render",
+    "execute_moves",
+    "advance_turn"
+};
+
+static struct histogram histograms[STAGES_N];
+
+static volatile sig_atomic_t dump_requested = 0;
+
+__thread unsigned long stats_idle = 0;
+struct stats_timer command_timer;
+
+unsigned long stats_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+void stats_start(struct stats_timer *t)
+{
+    t->idle = stats_idle;
+    t->start = stats_now();
+}
+
+static size_t magnitude(uint64_t v)
+{
+    size_t m = 0;
+
+    while (v >> (m + SUB_BITS)) {
+        m++;
+    }
+
+    return m;
+}
+
+static void hist_record(struct histogram *h, uint64_t v)
+{
+    size_t m = magnitude(v);
+    size_t s = m == 0 ? v : (v >> (m - 1)) & (SUB_N - 1);
+
+    atomic_fetch_add_explicit(&h->buckets[m][s], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, v, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+
+    while (v > max
+           && !atomic_compare_exchange_weak_explicit(&h->max, &max, v,
+                                                     memory_order_relaxed,
+                                                     memory_order_relaxed)) {
+    }
+}
+
+/* The count is summed from the buckets, so that percentiles stay
+ * consistent with them even if a record lands halfway through */
+static void hist_read(struct histogram *h, struct hist_copy *c)
+{
+    c->count = 0;
+
+    size_t m, s;
+    for (m = 0; m < ROWS_N; m++) {
+        for (s = 0; s < SUB_N; s++) {
+            c->buckets[m][s] = atomic_load_explicit(&h->buckets[m][s],
+                                                    memory_order_relaxed);
+            c->count += c->buckets[m][s];
+        }
+    }
+
+    c->total = atomic_load_explicit(&h->total, memory_order_relaxed);
+    c->max = atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+static uint64_t hist_percentile(const struct hist_copy *h, unsigned p)
+{
+    uint64_t rank = (h->count * p + 99) / 100;
+    uint64_t seen = 0;
+
+    size_t m, s;
+    for (m = 0; m < ROWS_N; m++) {
+        for (s = 0; s < SUB_N; s++) {
+            seen += h->buckets[m][s];
+
+            if (seen >= rank && seen > 0) {
+                uint64_t lo = m == 0 ? s : (uint64_t)(s | SUB_N) << (m - 1);
+                return lo < h->max ? lo : h->max;
+            }
+        }
+    }
+
+    return h->max;
+}
+
+void stats_stop(struct stats_timer *t, enum stage stage)
+{
+    unsigned long elapsed = stats_now() - t->start;
+    unsigned long idle = stats_idle - t->idle;
+
+    hist_record(&histograms[stage], elapsed > idle ? elapsed - idle : 0);
+}
+
+static void sigusr1_handler(int sig)
+{
+    (void)sig;
+    dump_requested = 1;
+}
+
+void stats_init()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = sigusr1_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+bool stats_requested()
+{
+    return dump_requested;
+}
+
+void stats_poll()
+{
+    if (dump_requested) {
+        dump_requested = 0;
+        print_stats();
+    }
+}
+
+static void print_ns(uint64_t ns)
+{
+    if (ns < 10000) {
+        printf(" %8lluns", (unsigned long long)ns);
+    } else if (ns < 10000000) {
+        printf(" %8.1fus", ns / 1e3);
+    } else {
+        printf(" %8.1fms", ns / 1e6);
+    }
+}
+
+void print_stats()
+{
+    printf("%-16s %8s %10s %10s %10s %10s %10s\n",
+           "stage", "count", "mean", "p50", "p90", "p99", "max");
+
+    static struct hist_copy copy;
+    struct hist_copy *h = &copy;
+
+    size_t i;
+    for (i = 0; i < STAGES_N; i++) {
+        hist_read(&histograms[i], h);
+
+        printf("%-16s %8llu", stage_names[i], (unsigned long long)h->count);
+
+        if (h->count == 0) {
+            putchar('\n');
+            continue;
+        }
+
+        print_ns(h->total / h->count);
+        print_ns(hist_percentile(h, 50));
+        print_ns(hist_percentile(h, 90));
+        print_ns(hist_percentile(h, 99));
+        print_ns(h->max);
+        putchar('\n');
+    }
+
+    print_cache_stats();
+    print_alloc_stats();
+}
@@ -0,0 +1,58 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdbool.h>
+
+enum stage {
+    STAGE_LEX,
+    STAGE_COMMAND,
+    STAGE_REGISTER_ORDER,
+    STAGE_REGISTRATION,
+    STAGE_ADJUDICATOR,
+    STAGE_RENDER,
+    STAGE_EXECUTE,
+    STAGE_ADVANCE,
+    STAGES_N
+};
+
+/* Time spent blocked on user input by the current thread, subtracted
+ * from every stage timed across it */
+extern __thread unsigned long stats_idle;
+
+struct stats_timer {
+    unsigned long start;
+    unsigned long idle;
+};
+
+/* Started when a command line is read, stopped when it is reduced */
+extern struct stats_timer command_timer;
+
+unsigned long stats_now();
+void stats_start(struct stats_timer *t);
+void stats_stop(struct stats_timer *t, enum stage stage);
+
+void stats_init();
+bool stats_requested();
+void stats_poll();
+void print_stats();
+
+#endif /* _STATS_H_ */
@@ -0,0 +1,386 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "commons.h"
+#include "alloc.h"
+#include "board.h"
+#include "submit.h"
+
+#define CACHE_LINE 64
+#define LINE_MAX_LEN 128
+
+struct submission {
+    struct order o;
+    unsigned phase;
+};
+
+struct order_queue {
+    atomic_size_t tail;
+    char pad1[CACHE_LINE - sizeof (atomic_size_t)];
+    atomic_size_t head;
+    char pad2[CACHE_LINE - sizeof (atomic_size_t)];
+    struct submission slots[SUBMIT_QUEUE_SIZE];
+};
+
+static struct order_queue queues[NATIONS_N];
+static atomic_uint phase;
+
+bool submit_order(enum cd_nation nat, const struct order *o)
+{
+    struct order_queue *q = &queues[trail0s(nat)];
+
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    if (tail - head == SUBMIT_QUEUE_SIZE) {
+        return false;
+    }
+
+    struct submission *s = &q->slots[tail % SUBMIT_QUEUE_SIZE];
+
+    s->o = *o;
+    s->phase = atomic_load_explicit(&phase, memory_order_acquire);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+void submit_next_phase()
+{
+    atomic_fetch_add_explicit(&phase, 1, memory_order_release);
+}
+
+size_t drain_submissions()
+{
+    size_t tails[NATIONS_N];
+
+    size_t i;
+    for (i = 0; i < NATIONS_N; i++) {
+        tails[i] = atomic_load_explicit(&queues[i].tail,
+                                        memory_order_acquire);
+    }
+
+    unsigned cur = atomic_load_explicit(&phase, memory_order_relaxed);
+    size_t n = 0;
+
+    for (i = 0; i < NATIONS_N; i++) {
+        struct order_queue *q = &queues[i];
+        enum cd_nation nat = 1u << i;
+
+        size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+        for (; head != tails[i]; head++) {
+            struct submission *s = &q->slots[head % SUBMIT_QUEUE_SIZE];
+
+            if (s->phase != cur) {
+                printf("%s: order for %s given in an earlier phase, "
+                       "dropped\n",
+                       get_nation_name(nat), get_terr_name(s->o.t1));
+            } else if (s->o.kind == NULL_ORDER) {
+                withdraw_order(nat, s->o.t1);
+                n++;
+            } else if (enter_order(nat, &s->o)) {
+                n++;
+            }
+        }
+
+        atomic_store_explicit(&q->head, head, memory_order_release);
+    }
+
+    return n;
+}
+
+static bool parse_terr_coast(char *tok, enum cd_terr *t, enum cd_coast *c)
+{
+    char *paren = strchr(tok, '(');
+
+    *c = NO_COAST;
+
+    if (paren != NULL) {
+        if (istrcmp(paren, "(nc)") == 0) {
+            *c = NORTH;
+        } else if (istrcmp(paren, "(sc)") == 0) {
+            *c = SOUTH;
+        } else {
+            return false;
+        }
+
+        *paren = '\0';
+    }
+
+    *t = get_terr(tok);
+
+    return (int)*t != NO_TERR;
+}
+
+/* A single unit's order, as typed at the prompt: "par h", "par-bur",
+ * "mao-spa(nc)", "lon-nwy via c", "mar s par", "mar s par-bur",
+ * "nth c lon-nwy", or "par withdraw" to take an order back */
+bool submit_parse(const char *line, struct order *o)
+{
+    char buf[LINE_MAX_LEN * 3];
+    size_t len = 0;
+
+    const char *c;
+    for (c = line; *c != '\0' && len + 3 < sizeof buf; c++) {
+        if (*c == '-') {
+            buf[len++] = ' ';
+            buf[len++] = '-';
+            buf[len++] = ' ';
+        } else {
+            buf[len++] = *c;
+        }
+    }
+
+    buf[len] = '\0';
+
+    char *tok[8];
+    size_t n = 0;
+
+    char *save;
+    char *t = strtok_r(buf, " \t\r\n", &save);
+    while (t != NULL && n < ARRSIZE(tok)) {
+        tok[n++] = t;
+        t = strtok_r(NULL, " \t\r\n", &save);
+    }
+
+    if (t != NULL || n < 2) {
+        return false;
+    }
+
+    enum cd_coast coast;
+
+    o->t2 = NO_TERR;
+    o->t3 = NO_TERR;
+    o->coast = NO_COAST;
+    o->viac = false;
+
+    if (!parse_terr_coast(tok[0], &o->t1, &coast) || coast != NO_COAST) {
+        return false;
+    }
+
+    if (n == 2 && istrcmp(tok[1], "h") == 0) {
+        o->kind = HOLD;
+    } else if (n == 2 && istrcmp(tok[1], "withdraw") == 0) {
+        o->kind = NULL_ORDER;
+    } else if (strcmp(tok[1], "-") == 0 && (n == 3 || n == 5)) {
+        o->kind = MOVE;
+        o->t2 = o->t1;
+
+        if (!parse_terr_coast(tok[2], &o->t3, &o->coast)) {
+            return false;
+        }
+
+        if (n == 5) {
+            if (istrcmp(tok[3], "via") != 0 || istrcmp(tok[4], "c") != 0) {
+                return false;
+            }
+
+            o->viac = true;
+        }
+    } else if (istrcmp(tok[1], "s") == 0 && n == 3) {
+        o->kind = SUPH;
+
+        if ((int)(o->t2 = get_terr(tok[2])) == NO_TERR) {
+            return false;
+        }
+    } else if ((istrcmp(tok[1], "s") == 0 || istrcmp(tok[1], "c") == 0)
+               && n == 5 && strcmp(tok[3], "-") == 0) {
+
+        o->kind = istrcmp(tok[1], "s") == 0 ? SUPM : CONV;
+
+        if ((int)(o->t2 = get_terr(tok[2])) == NO_TERR
+            || (int)(o->t3 = get_terr(tok[4])) == NO_TERR) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/* Per-nation input: one FIFO per power, named after it, whose reader
+ * thread parses a line at a time into that power's queue. A pipe wakes
+ * the readers up when the session ends */
+static pthread_t readers[NATIONS_N];
+static int fifos[NATIONS_N] = {-1, -1, -1, -1, -1, -1, -1};
+static char *fifo_paths[NATIONS_N];
+static int stop_pipe[2] = {-1, -1};
+static size_t readers_n = 0;
+
+static void submit_line(enum cd_nation nat, const char *line)
+{
+    struct order o;
+
+    if (!submit_parse(line, &o)) {
+        fprintf(stderr, "%s: cannot parse `%s'\n",
+                get_nation_name(nat), line);
+        return;
+    }
+
+    if (!submit_order(nat, &o)) {
+        fprintf(stderr, "%s: too many pending orders, `%s' dropped\n",
+                get_nation_name(nat), line);
+    }
+}
+
+static void *read_submissions(void *data)
+{
+    size_t i = (uintptr_t)data;
+    enum cd_nation nat = 1u << i;
+
+    char line[LINE_MAX_LEN];
+    size_t len = 0;
+
+    for (;;) {
+        struct pollfd pfd[] = {
+            {fifos[i], POLLIN, 0},
+            {stop_pipe[0], POLLIN, 0}
+        };
+
+        if (poll(pfd, ARRSIZE(pfd), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("poll");
+            break;
+        }
+
+        if (pfd[1].revents != 0) {
+            break;
+        }
+
+        ssize_t r = read(fifos[i], line + len, sizeof line - len - 1);
+        if (r <= 0) {
+            continue;
+        }
+
+        len += r;
+        line[len] = '\0';
+
+        char *start = line;
+        char *end;
+        while ((end = strchr(start, '\n')) != NULL) {
+            *end = '\0';
+
+            if (!strisblank(start)) {
+                submit_line(nat, start);
+            }
+
+            start = end + 1;
+        }
+
+        len -= start - line;
+        memmove(line, start, len);
+
+        if (len == sizeof line - 1) {
+            fprintf(stderr, "%s: line too long, dropped\n",
+                    get_nation_name(nat));
+            len = 0;
+        }
+    }
+
+    return NULL;
+}
+
+int submit_listen(const char *dir)
+{
+    if (pipe(stop_pipe) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < NATIONS_N; i++) {
+        const char *name = cd_nation_names[i];
+
+        fifo_paths[i] = xmalloc(strlen(dir) + strlen(name) + 2);
+        sprintf(fifo_paths[i], "%s/%s", dir, name);
+
+        if (mkfifo(fifo_paths[i], 0600) != 0 && errno != EEXIST) {
+            perror(fifo_paths[i]);
+            submit_close();
+            return -1;
+        }
+
+        /* Opened for writing too, so the FIFO never reports EOF when a
+         * client disconnects */
+        fifos[i] = open(fifo_paths[i], O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fifos[i] < 0) {
+            perror(fifo_paths[i]);
+            submit_close();
+            return -1;
+        }
+
+        if (pthread_create(&readers[i], NULL, read_submissions,
+                           (void *)(uintptr_t)i) != 0) {
+            fprintf(stderr, "%s: cannot start reader\n", fifo_paths[i]);
+            submit_close();
+            return -1;
+        }
+
+        readers_n++;
+    }
+
+    return 0;
+}
+
+void submit_close()
+{
+    if (stop_pipe[1] >= 0 && write(stop_pipe[1], "", 1) < 0) {
+        perror("submit_close");
+    }
+
+    size_t i;
+    for (i = 0; i < readers_n; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    readers_n = 0;
+
+    for (i = 0; i < NATIONS_N; i++) {
+        if (fifos[i] >= 0) {
+            close(fifos[i]);
+            fifos[i] = -1;
+        }
+
+        xfree(fifo_paths[i]);
+        fifo_paths[i] = NULL;
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (stop_pipe[i] >= 0) {
+            close(stop_pipe[i]);
+            stop_pipe[i] = -1;
+        }
+    }
+}
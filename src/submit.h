@@ -0,0 +1,47 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SUBMIT_H_
+#define _SUBMIT_H_
+
+#include <stdbool.h>
+
+#include <cdippy.h>
+
+#include "game.h"
+
+/* One single-producer/single-consumer ring per nation: each power's
+ * client thread pushes without locking, and the game thread drains all
+ * rings at once when the phase is adjudicated. A NULL_ORDER submission
+ * withdraws the order given to the unit in t1. Submissions are stamped
+ * with the phase they were made in, and dropped if drained in a later
+ * one. */
+
+#define SUBMIT_QUEUE_SIZE 128
+
+bool submit_order(enum cd_nation nat, const struct order *o);
+size_t drain_submissions();
+void submit_next_phase();
+
+bool submit_parse(const char *line, struct order *o);
+
+int submit_listen(const char *dir);
+void submit_close();
+
+#endif /* _SUBMIT_H_ */
@@ -0,0 +1,544 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "pprintf.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "cache.h"
+#include "eval.h"
+#include "workers.h"
+#include "suggest.h"
+
+#define CANDIDATES_MAX 48
+#define RESTARTS 4
+#define PASSES_MAX 8
+
+/* Transposition table entries pack the upper bits of the hash of an
+ * order combination together with its score, so that forked workers
+ * can share them through an anonymous shared mapping without locks */
+#define TT_BITS 18
+#define TT_SIZE (1ul << TT_BITS)
+#define TT_SCORE_BITS 24
+#define TT_SCORE_BIAS (1l << (TT_SCORE_BITS - 1))
+#define TT_SCORE_MASK ((1ull << TT_SCORE_BITS) - 1)
+
+#define SCORE_LOST_UNIT 8
+#define SCORE_DISLODGE 1
+
+struct candidates {
+    enum cd_terr t;
+    size_t n;
+    struct order c[CANDIDATES_MAX];
+};
+
+struct search_result {
+    int score;
+    unsigned long evaluations;
+    unsigned long tt_hits;
+    unsigned char choice[TERR_N];
+};
+
+struct search {
+    enum cd_nation nat;
+    uint64_t seed;
+
+    struct order base[TERR_N];
+    size_t base_n;
+
+    struct candidates units[TERR_N];
+    size_t units_n;
+    int unit_of[TERR_N];
+
+    atomic_uint_least64_t *tt;
+    struct search_result *results;
+};
+
+static uint64_t rng;
+
+static unsigned pick(unsigned n)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+
+    return (rng * 0x2545f4914f6cdd1dull >> 32) % n;
+}
+
+/* Adjudicates an order set, leaving the resulting position in after[]
+ * with every occupied center counted as taken, and returns the score
+ * adjustment for the units it dislodges */
+static int adjudicate_choice(const struct search *s,
+                             const unsigned char choice[],
+                             struct terr_info after[])
+{
+    const struct order *registered[2 * TERR_N];
+    size_t n = 0;
+
+    size_t i;
+    for (i = 0; i < s->base_n; i++) {
+        if (register_order_with_adjudicator(&s->base[i])) {
+            registered[n++] = &s->base[i];
+        }
+    }
+
+    for (i = 0; i < s->units_n; i++) {
+        const struct order *o = &s->units[i].c[choice[i]];
+
+        if (register_order_with_adjudicator(o)) {
+            registered[n++] = o;
+        }
+    }
+
+    cd_run_adjudicator();
+
+    memcpy(after, board, sizeof board);
+
+    for (i = 0; i < n; i++) {
+        if (registered[i]->kind == MOVE && cd_resolutions[i] == SUCCEEDS) {
+            after[registered[i]->t2].occupier = NO_NATION;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        const struct order *o = registered[i];
+
+        if (o->kind == MOVE && cd_resolutions[i] == SUCCEEDS) {
+            after[o->t3].occupier = board[o->t2].occupier;
+            after[o->t3].unit = board[o->t2].unit;
+            after[o->t3].coast = o->coast;
+        }
+    }
+
+    size_t t;
+    for (t = 0; t < TERR_N; t++) {
+        if (after[t].supp_center && after[t].occupier != NO_NATION) {
+            after[t].owner = after[t].occupier;
+        }
+    }
+
+    int adjust = 0;
+
+    for (i = 0; i < cd_retreats_n; i++) {
+        if (board[cd_retreats[i].who].occupier == s->nat) {
+            adjust -= SCORE_LOST_UNIT;
+        } else {
+            adjust += SCORE_DISLODGE;
+        }
+    }
+
+    return adjust;
+}
+
+static bool tt_lookup(const struct search *s, uint64_t key, int *score)
+{
+    const atomic_uint_least64_t *slot = &s->tt[key & (TT_SIZE - 1)];
+    uint64_t e = atomic_load_explicit(slot, memory_order_relaxed);
+
+    if (e == 0 || (e & ~TT_SCORE_MASK) != (key & ~TT_SCORE_MASK)) {
+        return false;
+    }
+
+    *score = (int)((long)(e & TT_SCORE_MASK) - TT_SCORE_BIAS);
+    return true;
+}
+
+static void tt_store(const struct search *s, uint64_t key, int score)
+{
+    atomic_uint_least64_t *slot = &s->tt[key & (TT_SIZE - 1)];
+    uint64_t e = (key & ~TT_SCORE_MASK)
+               | (uint64_t)((long)score + TT_SCORE_BIAS);
+
+    atomic_store_explicit(slot, e, memory_order_relaxed);
+}
+
+/* Supports of our own units only make sense when they match what the
+ * supported unit is currently doing */
+static bool pruned(const struct search *s, const unsigned char choice[],
+                   const struct order *o)
+{
+    if (o->kind != SUPH && o->kind != SUPM) {
+        return false;
+    }
+
+    int j = s->unit_of[o->t2];
+    if (j < 0) {
+        return false;
+    }
+
+    const struct order *other = &s->units[j].c[choice[j]];
+
+    if (o->kind == SUPH) {
+        return other->kind == MOVE;
+    }
+
+    return other->kind != MOVE || other->t3 != o->t3;
+}
+
+/* Scores the order sets obtained by giving unit i each of its candidate
+ * orders, adjudicating those missing from the transposition table and
+ * evaluating the resulting positions as one batch */
+static void score_candidates(const struct search *s, unsigned char choice[],
+                             size_t i, int scores[], struct search_result *r)
+{
+    static struct eval_batch batch;
+    static int16_t batch_scores[NATIONS_N][EVAL_BATCH];
+
+    struct terr_info after[TERR_N];
+    uint64_t keys[CANDIDATES_MAX];
+    int adjust[CANDIDATES_MAX];
+    int slots[CANDIDATES_MAX];
+
+    unsigned char keep = choice[i];
+    const struct candidates *u = &s->units[i];
+
+    eval_clear(&batch);
+
+    size_t k;
+    for (k = 0; k < u->n; k++) {
+        slots[k] = -1;
+        choice[i] = k;
+
+        if (pruned(s, choice, &u->c[k])) {
+            scores[k] = INT_MIN;
+            continue;
+        }
+
+        keys[k] = hash_bytes(choice, s->units_n);
+
+        if (tt_lookup(s, keys[k], &scores[k])) {
+            r->tt_hits++;
+            continue;
+        }
+
+        adjust[k] = adjudicate_choice(s, choice, after);
+        slots[k] = eval_add(&batch, after);
+        r->evaluations++;
+    }
+
+    choice[i] = keep;
+
+    eval_run(&batch, batch_scores);
+
+    size_t nat_i = trail0s(s->nat);
+
+    for (k = 0; k < u->n; k++) {
+        if (slots[k] >= 0) {
+            scores[k] = batch_scores[nat_i][slots[k]] + adjust[k];
+            tt_store(s, keys[k], scores[k]);
+        }
+    }
+}
+
+/* Moves every unit in turn to its best candidate until nothing improves;
+ * ties go to the candidate tried first */
+static int climb(const struct search *s, unsigned char choice[],
+                 struct search_result *r)
+{
+    int best = INT_MIN;
+    int scores[CANDIDATES_MAX];
+
+    bool improved = true;
+    unsigned pass;
+    for (pass = 0; improved && pass < PASSES_MAX; pass++) {
+        improved = false;
+
+        size_t i;
+        for (i = 0; i < s->units_n; i++) {
+            const struct candidates *u = &s->units[i];
+
+            score_candidates(s, choice, i, scores, r);
+
+            if (scores[choice[i]] > best) {
+                best = scores[choice[i]];
+            }
+
+            size_t k;
+            for (k = 0; k < u->n; k++) {
+                if (scores[k] > best) {
+                    best = scores[k];
+                    choice[i] = k;
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+static void suggest_work(size_t w, size_t n, int fd, void *data)
+{
+    (void)n;
+
+    const struct search *s = data;
+
+    struct search_result best, r;
+    memset(&r, 0, sizeof r);
+    best.score = INT_MIN;
+
+    rng = s->seed ^ (0x9e3779b97f4a7c15ull * (w + 1));
+    if (rng == 0) {
+        rng = 1;
+    }
+
+    unsigned restart;
+    for (restart = 0; restart < RESTARTS; restart++) {
+        size_t i;
+        for (i = 0; i < s->units_n; i++) {
+            r.choice[i] = w == 0 && restart == 0 ? 0 : pick(s->units[i].n);
+        }
+
+        r.score = climb(s, r.choice, &r);
+
+        if (r.score > best.score) {
+            best = r;
+        }
+    }
+
+    best.evaluations = r.evaluations;
+    best.tt_hits = r.tt_hits;
+
+    write_full(fd, &best, sizeof best);
+}
+
+static bool suggest_collect(size_t w, int fd, void *data)
+{
+    struct search *s = data;
+
+    return read_full(fd, &s->results[w], sizeof s->results[w]);
+}
+
+static int order_priority(const struct search *s, const struct order *o)
+{
+    enum cd_terr target = o->kind == MOVE || o->kind == SUPM ? o->t3
+                                                             : o->t2;
+    const struct terr_info *ti = &board[target != NO_TERR ? target : o->t1];
+    bool gain = ti->supp_center && ti->owner != s->nat;
+
+    switch (o->kind) {
+    case MOVE:
+        return ti->occupier == s->nat ? 0 : gain ? 30 : 10;
+
+    case SUPM:
+        return gain ? 25 : 8;
+
+    case HOLD:
+        return ti->supp_center ? 15 : 5;
+
+    case SUPH:
+        return ti->supp_center ? 12 : 4;
+
+    default:
+        return 0;
+    }
+}
+
+static void add_candidate(struct search *s, struct candidates *u,
+                          int priorities[], const struct order *o)
+{
+    int p = order_priority(s, o);
+
+    size_t i = u->n < CANDIDATES_MAX ? u->n++ : CANDIDATES_MAX;
+    while (i > 0 && priorities[i-1] < p) {
+        if (i < CANDIDATES_MAX) {
+            u->c[i] = u->c[i-1];
+            priorities[i] = priorities[i-1];
+        }
+
+        i--;
+    }
+
+    if (i < CANDIDATES_MAX) {
+        u->c[i] = *o;
+        priorities[i] = p;
+    }
+}
+
+static void build_candidates(struct search *s, struct candidates *u)
+{
+    const struct terr_info *ti = &board[u->t];
+    const struct adjacency *adj = map_adjacency(u->t, ti->unit, ti->coast);
+    int priorities[CANDIDATES_MAX];
+
+    struct order o = {HOLD, u->t, NO_TERR, {NO_TERR}, NO_COAST, false};
+    add_candidate(s, u, priorities, &o);
+
+    size_t i;
+    for (i = 0; i < adj->n; i++) {
+        enum cd_terr to = adj->to[i].terr;
+
+        o.kind = MOVE;
+        o.t2 = u->t;
+        o.t3 = to;
+        o.coast = ti->unit == FLEET ? adj->to[i].coast : NO_COAST;
+        add_candidate(s, u, priorities, &o);
+
+        o.coast = NO_COAST;
+
+        if (board[to].occupier != NO_NATION) {
+            o.kind = SUPH;
+            o.t2 = to;
+            o.t3 = NO_TERR;
+            add_candidate(s, u, priorities, &o);
+        }
+
+        enum cd_terr t;
+        for (t = 0; t < TERR_N; t++) {
+            const struct terr_info *other = &board[t];
+
+            if (t == u->t || other->occupier == NO_NATION
+                || !map_adjacent(t, other->unit, other->coast, to)) {
+                continue;
+            }
+
+            o.kind = SUPM;
+            o.t2 = t;
+            o.t3 = to;
+            add_candidate(s, u, priorities, &o);
+        }
+    }
+}
+
+static void print_suggestion(const struct search *s,
+                             const struct search_result *best,
+                             unsigned long evaluations,
+                             unsigned long tt_hits,
+                             size_t workers)
+{
+    pprintf_init();
+
+    pprintf("\nSuggested orders for %s (score %d)\n",
+            get_nation_name(s->nat), best->score);
+
+    size_t i;
+    for (i = 0; i < s->units_n; i++) {
+        pprintf("  ");
+        pprint_order((struct order *)&s->units[i].c[best->choice[i]]);
+        pputchar('\n');
+    }
+
+    pprintf("\n%lu order sets adjudicated, %lu from the transposition "
+            "table, %zu workers\n\n", evaluations, tt_hits, workers);
+}
+
+void suggest(enum cd_nation nat)
+{
+    if (!awaiting_orders()) {
+        puts("Suggestions are only available in a main phase");
+        return;
+    }
+
+    eval_init();
+
+    static struct search s;
+
+    s.nat = nat;
+    s.seed = (uint64_t)time(NULL) << 20 ^ (uint64_t)getpid();
+    s.base_n = 0;
+    s.units_n = 0;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        if ((1u << nat_i) == nat) {
+            continue;
+        }
+
+        const struct order *orders;
+        size_t n = nation_orders(1u << nat_i, &orders);
+
+        size_t i;
+        for (i = 0; i < n; i++) {
+            if (board[orders[i].t1].occupier == (1u << nat_i)) {
+                s.base[s.base_n++] = orders[i];
+            }
+        }
+    }
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        s.unit_of[t] = -1;
+
+        if (board[t].occupier == nat) {
+            s.unit_of[t] = s.units_n;
+            s.units[s.units_n].t = t;
+            s.units[s.units_n].n = 0;
+            s.units_n++;
+        }
+    }
+
+    if (s.units_n == 0) {
+        printf("%s has no units\n", get_nation_name(nat));
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < s.units_n; i++) {
+        build_candidates(&s, &s.units[i]);
+    }
+
+    s.tt = mmap(NULL, TT_SIZE * sizeof s.tt[0], PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (s.tt == MAP_FAILED) {
+        perror("mmap");
+        return;
+    }
+
+    size_t workers = workers_n();
+    struct search_result results[workers];
+
+    s.results = results;
+
+    if (!run_workers(workers, suggest_work, suggest_collect, &s)) {
+        puts("Search failed");
+        munmap(s.tt, TT_SIZE * sizeof s.tt[0]);
+        return;
+    }
+
+    munmap(s.tt, TT_SIZE * sizeof s.tt[0]);
+
+    size_t best = 0;
+    unsigned long evaluations = 0;
+    unsigned long tt_hits = 0;
+
+    for (i = 0; i < workers; i++) {
+        evaluations += results[i].evaluations;
+        tt_hits += results[i].tt_hits;
+
+        if (results[i].score > results[best].score) {
+            best = i;
+        }
+    }
+
+    print_suggestion(&s, &results[best], evaluations, tt_hits, workers);
+}
@@ -0,0 +1,231 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cdippy.h>
+
+#include "commons.h"
+#include "pprintf.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "targets.h"
+
+enum ref_kind {
+    REF_MOVE,
+    REF_SUPPORT,
+    REF_CONVOY,
+    REFS_N
+};
+
+/* For every territory, the territories of the units whose orders move
+ * into it, support a unit holding or moving there, or convoy from or to
+ * it, one set per nation since two nations may order the same square */
+static struct terrset refs[TERR_N][REFS_N][NATIONS_N];
+
+static void set_ref(enum cd_terr target, enum ref_kind kind,
+                    size_t nat_i, enum cd_terr t1, bool on)
+{
+    if (target == NO_TERR) {
+        return;
+    }
+
+    uint64_t bit = 1ull << (t1 % 64);
+    uint64_t *w = &refs[target][kind][nat_i].w[t1 / 64];
+
+    *w = on ? *w | bit : *w & ~bit;
+}
+
+static void update(enum cd_nation nat, const struct order *o, bool on)
+{
+    size_t nat_i = trail0s(nat);
+
+    switch (o->kind) {
+    case MOVE:
+        set_ref(o->t3, REF_MOVE, nat_i, o->t1, on);
+        break;
+
+    case SUPH:
+        set_ref(o->t2, REF_SUPPORT, nat_i, o->t1, on);
+        break;
+
+    case SUPM:
+        set_ref(o->t3, REF_SUPPORT, nat_i, o->t1, on);
+        break;
+
+    case CONV:
+        set_ref(o->t2, REF_CONVOY, nat_i, o->t1, on);
+        set_ref(o->t3, REF_CONVOY, nat_i, o->t1, on);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void targets_add(enum cd_nation nat, const struct order *o)
+{
+    update(nat, o, true);
+}
+
+void targets_remove(enum cd_nation nat, const struct order *o)
+{
+    update(nat, o, false);
+}
+
+void targets_clear()
+{
+    memset(refs, 0, sizeof refs);
+}
+
+static size_t count_refs(enum cd_terr t, enum ref_kind kind)
+{
+    size_t n = 0;
+
+    size_t nat_i, w;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (w = 0; w < TERRSET_WORDS; w++) {
+            n += __builtin_popcountll(refs[t][kind][nat_i].w[w]);
+        }
+    }
+
+    return n;
+}
+
+static void print_refs(enum cd_terr t, enum ref_kind kind)
+{
+    size_t nat_i, w;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        enum cd_nation nat = 1u << nat_i;
+
+        const struct order *orders;
+        nation_orders(nat, &orders);
+
+        for (w = 0; w < TERRSET_WORDS; w++) {
+            uint64_t m = refs[t][kind][nat_i].w[w];
+
+            while (m != 0) {
+                enum cd_terr t1 = w * 64 + trail0s(m);
+                m &= m - 1;
+
+                size_t i = find_order(nat, t1);
+
+                pprintf("  %3zu: %-8s ", get_orders_base_index(nat) + i,
+                        get_nation_name(nat));
+                pprint_order((struct order *)&orders[i]);
+                pputchar('\n');
+            }
+        }
+    }
+}
+
+void print_orders_into(enum cd_terr t)
+{
+    pprintf_init();
+
+    static const char *titles[] = {
+        "Moves into",
+        "Supports into",
+        "Convoys from or to"
+    };
+
+    bool any = false;
+
+    size_t kind;
+    for (kind = 0; kind < REFS_N; kind++) {
+        if (count_refs(t, kind) == 0) {
+            continue;
+        }
+
+        pprintf("%s %s\n", titles[kind], get_terr_name(t));
+        print_refs(t, kind);
+        any = true;
+    }
+
+    if (!any) {
+        pprintf("No orders into %s\n", get_terr_name(t));
+    }
+}
+
+/* Returns where the unit in t is ordered to if a unit there is ordered
+ * back into t, NO_TERR otherwise */
+static enum cd_terr head_to_head(enum cd_terr t)
+{
+    enum cd_nation nat = board[t].occupier;
+
+    if (nat == NO_NATION) {
+        return NO_TERR;
+    }
+
+    const struct order *orders;
+    size_t n = nation_orders(nat, &orders);
+    size_t i = find_order(nat, t);
+
+    if (i >= n || orders[i].kind != MOVE) {
+        return NO_TERR;
+    }
+
+    enum cd_terr to = orders[i].t3;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        if (terrset_has(&refs[t][REF_MOVE][nat_i], to)) {
+            return to;
+        }
+    }
+
+    return NO_TERR;
+}
+
+/* Standoffs are two or more units ordered into the same territory; head
+ * to head battles are listed once, under the first of the two */
+void print_conflicts()
+{
+    pprintf_init();
+
+    bool any = false;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (count_refs(t, REF_MOVE) >= 2) {
+            pprintf("%s: standoff\n", get_terr_name(t));
+            print_refs(t, REF_MOVE);
+            print_refs(t, REF_SUPPORT);
+            any = true;
+        }
+
+        enum cd_terr other = head_to_head(t);
+
+        if (other != NO_TERR && other > t) {
+            pprintf("%s-%s: head to head\n",
+                    get_terr_name(t), get_terr_name(other));
+            print_refs(t, REF_MOVE);
+            print_refs(other, REF_MOVE);
+            print_refs(t, REF_SUPPORT);
+            print_refs(other, REF_SUPPORT);
+            any = true;
+        }
+    }
+
+    if (!any) {
+        pprintf("No conflicts\n");
+    }
+}
@@ -0,0 +1,135 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "workers.h"
+
+size_t workers_n()
+{
+    const char *env = getenv("CDIPPY_WORKERS");
+    if (env != NULL && atoi(env) > 0) {
+        return (size_t)atoi(env);
+    }
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (size_t)n : 1;
+}
+
+bool read_full(int fd, void *buf, size_t size)
+{
+    char *p = buf;
+
+    while (size > 0) {
+        ssize_t r = read(fd, p, size);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (r <= 0) {
+            return false;
+        }
+
+        p += r;
+        size -= r;
+    }
+
+    return true;
+}
+
+bool write_full(int fd, const void *buf, size_t size)
+{
+    const char *p = buf;
+
+    while (size > 0) {
+        ssize_t w = write(fd, p, size);
+
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (w <= 0) {
+            return false;
+        }
+
+        p += w;
+        size -= w;
+    }
+
+    return true;
+}
+
+bool run_workers(size_t n, work_fn work, collect_fn collect, void *data)
+{
+    pid_t pids[n];
+    int fds[n];
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        int p[2];
+
+        if (pipe(p) != 0) {
+            break;
+        }
+
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            close(p[0]);
+            close(p[1]);
+            break;
+        }
+
+        if (pid == 0) {
+            close(p[0]);
+            work(i, n, p[1], data);
+            _exit(0);
+        }
+
+        close(p[1]);
+        pids[i] = pid;
+        fds[i] = p[0];
+    }
+
+    bool ok = i == n;
+    size_t started = i;
+
+    for (i = 0; i < started; i++) {
+        if (ok && !collect(i, fds[i], data)) {
+            ok = false;
+        }
+
+        close(fds[i]);
+
+        int status;
+        while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
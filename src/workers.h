@@ -0,0 +1,42 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* The cdippy adjudicator keeps its state in globals, so independent
+ * adjudications are parallelized across forked processes rather than
+ * threads: each child gets its own copy of the adjudicator, runs
+ * work(i, n, fd) and streams its results back through fd, which the
+ * parent hands to collect(i, fd) in worker order. $CDIPPY_WORKERS
+ * overrides the number of processors. */
+
+typedef void (*work_fn)(size_t i, size_t n, int fd, void *data);
+typedef bool (*collect_fn)(size_t i, int fd, void *data);
+
+size_t workers_n();
+bool run_workers(size_t n, work_fn work, collect_fn collect, void *data);
+
+bool read_full(int fd, void *buf, size_t size);
+bool write_full(int fd, const void *buf, size_t size);
+
+#endif /* _WORKERS_H_ */
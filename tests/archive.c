@@ -0,0 +1,352 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Imports a small DPjudge-style archive and checks the phases, units
+ * and orders read from it, then indexes it into a position database
+ * and looks the positions up again. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "import.h"
+#include "positions.h"
+
+#include "capture.h"
+
+static const char *archive_text =
+    "From: judge@example.org\n"
+    "Subject: Diplomacy results test S1901M\n"
+    "\n"
+    "Movement results for Spring of 1901.  (test.19010SM)\n"
+    "\n"
+    "Austria:  Army  Budapest -> Serbia.\n"
+    "England:  Fleet London -> North Sea.\n"
+    "France:   Army  Marseilles SUPPORT Army Paris -> Burgundy.\n"
+    "France:   Army  Paris -> Burgundy.\n"
+    "Germany:  Army  Munich HOLD.\n"
+    "Italy:    Army  Rome -> Atlantis.\n"
+    "Russia:   Fleet St. Petersburg (south coast) -> Gulf of Bothnia.\n"
+    "Turkey:   Army  Smyrna -> Armenia.  (*bounce*)\n"
+    "\n"
+    "Retreat results for Spring of 1901.  (test.19010SR)\n"
+    "\n"
+    "Austria:  Army  Serbia -> Albania.\n"
+    "\n"
+    "Movement results for Fall of 1901.  (test.19010FM)\n"
+    "\n"
+    "Austria:  Army  Serbia HOLD.\n"
+    "England:  Fleet North Sea CONVOY Army Yorkshire -> Norway.\n"
+    "England:  Army  Yorkshire -> North Sea -> Norway.\n"
+    "France:   Army  Burgundy -> Munich.  (*bounce*)\n"
+    "Germany:  Army  Munich SUPPORT Army Ruhr.\n"
+    "Germany:  Army  Ruhr HOLD.\n"
+    "Russia:   Fleet Gulf of Bothnia -> Sweden.\n"
+    "\n"
+    "Ownership of supply centers:\n"
+    "\n"
+    "Austria:  Budapest, Serbia, Trieste, Vienna.\n"
+    "\n"
+    "Movement results for Spring of 1901.  (game2.19010SM)\n"
+    "\n"
+    "Austria:  Army  Budapest -> Serbia.\n"
+    "England:  Fleet London -> North Sea.\n"
+    "France:   Army  Marseilles SUPPORT Army Paris -> Burgundy.\n"
+    "France:   Army  Paris -> Burgundy.\n"
+    "Germany:  Army  Munich HOLD.\n"
+    "Russia:   Fleet St. Petersburg (south coast) -> Gulf of Bothnia.\n"
+    "Turkey:   Army  Smyrna -> Armenia.  (*bounce*)\n";
+
+#define PHASES_MAX 4
+
+static struct import_phase phases[PHASES_MAX];
+static size_t phases_n = 0;
+
+static size_t failed = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failed++;
+    }
+}
+
+static bool collect(const struct import_phase *phase, void *data)
+{
+    (void)data;
+
+    if (phases_n < PHASES_MAX) {
+        phases[phases_n] = *phase;
+    }
+
+    phases_n++;
+    return true;
+}
+
+static const struct order *find(const struct import_phase *p,
+                                enum cd_nation nat, enum cd_terr t1)
+{
+    size_t nat_i = trail0s(nat);
+
+    size_t i;
+    for (i = 0; i < p->orders_n[nat_i]; i++) {
+        if (p->orders[nat_i][i].t1 == t1) {
+            return &p->orders[nat_i][i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool is_order(const struct order *o, enum order_kind kind,
+                     enum cd_terr t2, enum cd_terr t3, bool viac)
+{
+    return o != NULL && o->kind == kind && o->t2 == t2 && o->t3 == t3
+           && o->viac == viac;
+}
+
+static char *write_archive(char *path)
+{
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        perror(path);
+        exit(2);
+    }
+
+    size_t len = strlen(archive_text);
+
+    if (write(fd, archive_text, len) != (ssize_t)len) {
+        perror(path);
+        exit(2);
+    }
+
+    close(fd);
+    return path;
+}
+
+static void test_import(const char *archive)
+{
+    struct import_stats st;
+
+    check(import_archive(archive, collect, NULL, &st) == 0, "import");
+
+    check(st.phases == 3 && phases_n == 3,
+          "movement phases imported, retreats passed over");
+    check(st.orders == 21, "orders imported");
+    check(st.skipped == 1, "order to an unknown territory skipped");
+
+    const struct import_phase *p = &phases[0];
+
+    check(p->year == 1901 && p->season == SPRING, "first phase date");
+    check(p->units[STP].occupier == RUSSIA && p->units[STP].unit == FLEET
+          && p->units[STP].coast == SOUTH, "fleet on a coast");
+    check(p->units[ROM].occupier == NO_NATION, "skipped unit not placed");
+
+    check(is_order(find(p, AUSTRIA, BUD), MOVE, BUD, SER, false),
+          "move");
+    check(is_order(find(p, FRANCE, MAR), SUPM, PAR, BUR, false),
+          "support to move");
+    check(is_order(find(p, GERMANY, MUN), HOLD, MUN, NO_TERR, false),
+          "hold");
+    check(is_order(find(p, RUSSIA, STP), MOVE, STP, BOT, false),
+          "move from a coast");
+
+    p = &phases[1];
+
+    check(p->year == 1901 && p->season == AUTUMN, "second phase date");
+    check(p->units[SER].occupier == AUSTRIA, "unit moved in spring");
+    check(is_order(find(p, ENGLAND, NTH), CONV, YOR, NWY, false),
+          "convoy");
+    check(is_order(find(p, ENGLAND, YOR), MOVE, YOR, NWY, true),
+          "move through listed seas");
+    check(is_order(find(p, GERMANY, MUN), SUPH, RUH, NO_TERR, false),
+          "support to hold");
+    check(find(p, AUSTRIA, BUD) == NULL, "ownership report ignored");
+
+    p = &phases[2];
+
+    check(p->year == 1901 && p->season == SPRING, "third phase date");
+    check(p->units[ROM].occupier == NO_NATION
+          && p->units[SER].occupier == NO_NATION,
+          "no units left over from earlier phases");
+}
+
+static char *find_position(uint64_t hash)
+{
+    capture_begin();
+    positions_find(hash);
+    return capture_end();
+}
+
+static void test_positions(const char *archive, const char *db)
+{
+    capture_begin();
+    int r = positions_open(db, true);
+    if (r == 0) {
+        r = positions_index(archive);
+    }
+    positions_close();
+    char *out = capture_end();
+
+    check(r == 0 && strstr(out, "Indexed 3 positions from 2 games") != NULL,
+          "index archive");
+    free(out);
+
+    struct position_record spring, autumn;
+
+    capture_begin();
+    import_load(&phases[0]);
+    pack_board(&spring);
+    import_load(&phases[1]);
+    pack_board(&autumn);
+    free(capture_end());
+
+    char next[64];
+    snprintf(next, sizeof next, "    next: %016llx (1901 Autumn)\n",
+             (unsigned long long)autumn.hash);
+
+    out = find_position(spring.hash);
+
+    check(strstr(out, "Seen 2 times\n") != NULL,
+          "same position in two games");
+    check(strstr(out, "1901 Spring, game 1\n") != NULL
+          && strstr(out, "1901 Spring, game 0\n") != NULL
+          && strstr(out, "game 1") < strstr(out, "game 0"),
+          "records of both games, latest first");
+    check(strstr(out, "    France   MAR S PAR-BUR\n") != NULL
+          && strstr(out, "    Russia   STP-BOT\n") != NULL,
+          "orders of the position");
+    check(strstr(out, next) != NULL, "link to the next phase");
+    free(out);
+
+    out = find_position(autumn.hash);
+
+    check(strstr(out, "Seen 1 time\n") != NULL
+          && strstr(out, "    England  NTH C YOR-NWY\n") != NULL
+          && strstr(out, "    England  YOR-NWY VIA C\n") != NULL,
+          "orders of the next phase");
+    free(out);
+
+    /* Cut the last record, the second game's spring, short */
+    FILE *f = fopen(db, "r");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+
+    check(truncate(db, size - 8) == 0, "truncate database");
+
+    out = find_position(spring.hash);
+
+    check(strstr(out, "record truncated\n") != NULL
+          && strstr(out, "game 1") == NULL,
+          "truncated record not read past the end");
+    free(out);
+
+    positions_close();
+}
+
+static uint64_t get_header(const char *idx, long offset)
+{
+    uint64_t value = 0;
+
+    FILE *f = fopen(idx, "rb");
+    fseek(f, offset, SEEK_SET);
+    fread(&value, sizeof value, 1, f);
+    fclose(f);
+
+    return value;
+}
+
+static void set_header(const char *idx, long offset, uint64_t value)
+{
+    FILE *f = fopen(idx, "r+b");
+    fseek(f, offset, SEEK_SET);
+    fwrite(&value, sizeof value, 1, f);
+    fclose(f);
+}
+
+static bool opens(const char *db)
+{
+    capture_begin();
+    int r = positions_open(db, false);
+    positions_close();
+    char *out = capture_end();
+
+    bool rejected = strstr(out, "not a position index\n") != NULL;
+    free(out);
+
+    return r == 0 && !rejected;
+}
+
+/* Header fields are capacity at 8 and count at 16; a header-only file
+ * matches the size of a table with no slots, or one whose size wraps */
+static void test_corrupt_index(const char *db, const char *idx)
+{
+    check(opens(db), "intact index opens");
+
+    set_header(idx, 16, get_header(idx, 8));
+    check(!opens(db), "index as full as its capacity rejected");
+
+    check(truncate(idx, 40) == 0, "truncate index to its header");
+
+    set_header(idx, 16, 0);
+    set_header(idx, 8, 0);
+    check(!opens(db), "index with no slots rejected");
+
+    set_header(idx, 8, 1ull << 61);
+    check(!opens(db), "index whose size wraps rejected");
+}
+
+int main()
+{
+    board_init();
+    map_init();
+    game_init();
+
+    char archive[] = "/tmp/cdippy-archive-XXXXXX";
+    write_archive(archive);
+
+    test_import(archive);
+
+    char db[] = "/tmp/cdippy-positions-XXXXXX";
+    close(mkstemp(db));
+
+    char idx[sizeof db + 4];
+    snprintf(idx, sizeof idx, "%s.idx", db);
+
+    test_positions(archive, db);
+    test_corrupt_index(db, idx);
+
+    unlink(archive);
+    unlink(db);
+    unlink(idx);
+
+    printf("%s\n", failed == 0 ? "archive tests passed"
+                               : "archive tests failed");
+
+    return failed == 0 ? 0 : 1;
+}
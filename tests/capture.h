@@ -0,0 +1,64 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+/* Collects what the code under test prints on stdout, so tests can
+ * compare it against the expected text */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static int capture_fd = -1;
+static FILE *capture_file = NULL;
+
+static inline void capture_begin()
+{
+    fflush(stdout);
+
+    capture_file = tmpfile();
+    capture_fd = dup(STDOUT_FILENO);
+
+    dup2(fileno(capture_file), STDOUT_FILENO);
+}
+
+/* Returns the captured text, to be released with free() */
+static inline char *capture_end()
+{
+    fflush(stdout);
+
+    dup2(capture_fd, STDOUT_FILENO);
+    close(capture_fd);
+
+    long size = lseek(fileno(capture_file), 0, SEEK_END);
+    char *text = malloc(size + 1);
+
+    rewind(capture_file);
+    size = fread(text, 1, size, capture_file);
+    text[size] = '\0';
+
+    fclose(capture_file);
+    capture_file = NULL;
+
+    return text;
+}
+
+#endif /* _CAPTURE_H_ */
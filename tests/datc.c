@@ -0,0 +1,875 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs DATC-style adjudication cases in-process through the board and
+ * game API, checks every resolution and times each case.
+ *
+ * Usage: datc [--bench | --record] [CASES [BASELINE]]
+ *
+ * CASES and BASELINE default to $DATC_CASES and $DATC_BASELINE. When a
+ * baseline is given, a case whose median latency exceeds it by more
+ * than $DATC_THRESHOLD percent (default 50) and by more than 20 us
+ * fails the run, and so does a missing baseline or a case missing from
+ * it; --record rewrites the baseline instead, --bench also prints
+ * every latency.
+ *
+ * Cases with a `then' block are re-resolved incrementally after
+ * changing the orders it lists, with verification on; cases with a
+ * `next' block have their first orders carried out, and are then
+ * resolved again with the orders it gives from the new position. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "cache.h"
+
+#include "capture.h"
+
+#define MAX_CASES 256
+#define MAX_UNITS 34
+#define REPS 51
+#define SLACK_NS 20000
+
+struct unit_line {
+    enum cd_nation nat;
+    enum cd_unit unit;
+    struct terr_coast tc;
+
+    enum order_kind kind;
+    enum cd_terr t2;
+    struct terr_coast t3c;
+    bool viac;
+
+    int expect;
+    bool illegal;
+};
+
+/* Orders given after the first ones, and what must be dislodged once
+ * they are resolved */
+struct step {
+    struct unit_line lines[MAX_UNITS];
+    size_t lines_n;
+
+    enum cd_terr dislodged[MAX_UNITS];
+    size_t dislodged_n;
+    bool check_dislodged;
+};
+
+struct datc_case {
+    char name[128];
+    int line;
+
+    struct unit_line units[MAX_UNITS];
+    size_t units_n;
+
+    enum cd_terr dislodged[MAX_UNITS];
+    size_t dislodged_n;
+    bool check_dislodged;
+
+    struct step then;
+    struct step next;
+
+    unsigned long ns;
+};
+
+static struct datc_case cases[MAX_CASES];
+static size_t cases_n = 0;
+
+static bool parse_tc(const char *s, struct terr_coast *tc)
+{
+    char name[8];
+    size_t len = strcspn(s, "(");
+
+    if (len == 0 || len >= sizeof name) {
+        return false;
+    }
+
+    memcpy(name, s, len);
+    name[len] = '\0';
+
+    tc->terr = get_terr(name);
+    tc->coast = NO_COAST;
+
+    if (istrcmp(s + len, "(NC)") == 0) {
+        tc->coast = NORTH;
+    } else if (istrcmp(s + len, "(SC)") == 0) {
+        tc->coast = SOUTH;
+    } else if (s[len] != '\0') {
+        return false;
+    }
+
+    return (int)tc->terr != NO_TERR;
+}
+
+static enum cd_terr parse_terr(const char *s)
+{
+    return s != NULL ? (enum cd_terr)get_terr(s) : NO_TERR;
+}
+
+static int parse_expect(const char *s)
+{
+    if (s == NULL) {
+        return -1;
+    } else if (istrcmp(s, "succeeds") == 0) {
+        return SUCCESS;
+    } else if (istrcmp(s, "fails") == 0) {
+        return FAILURE;
+    } else {
+        return -2;
+    }
+}
+
+static bool parse_unit(char *line, struct unit_line *u)
+{
+    char *tok[10];
+    size_t n = 0;
+
+    char *t = strtok(line, " \t\n");
+    while (t != NULL && n < ARRSIZE(tok)) {
+        tok[n++] = t;
+        t = strtok(NULL, " \t\n");
+    }
+
+    if (n < 4) {
+        return false;
+    }
+
+    u->nat = get_nation(tok[0]);
+
+    if (istrcmp(tok[1], "A") == 0) {
+        u->unit = ARMY;
+    } else if (istrcmp(tok[1], "F") == 0) {
+        u->unit = FLEET;
+    } else {
+        return false;
+    }
+
+    if (u->nat == NO_NATION || !parse_tc(tok[2], &u->tc)) {
+        return false;
+    }
+
+    u->t2 = NO_TERR;
+    u->t3c.terr = NO_TERR;
+    u->t3c.coast = NO_COAST;
+    u->viac = false;
+    u->illegal = false;
+
+    size_t rest;
+
+    if (istrcmp(tok[3], "H") == 0) {
+        u->kind = HOLD;
+        rest = 4;
+    } else if (strcmp(tok[3], "-") == 0 && n >= 5) {
+        u->kind = MOVE;
+
+        if (!parse_tc(tok[4], &u->t3c)) {
+            return false;
+        }
+
+        rest = 5;
+
+        if (n > rest && istrcmp(tok[rest], "VIA") == 0) {
+            u->viac = true;
+            rest++;
+        }
+    } else if ((istrcmp(tok[3], "S") == 0 || istrcmp(tok[3], "C") == 0)
+               && n >= 5) {
+
+        bool conv = istrcmp(tok[3], "C") == 0;
+
+        u->t2 = parse_terr(tok[4]);
+        rest = 5;
+
+        if (n >= 7 && strcmp(tok[5], "-") == 0) {
+            u->kind = conv ? CONV : SUPM;
+            u->t3c.terr = parse_terr(tok[6]);
+            rest = 7;
+
+            if ((int)u->t3c.terr == NO_TERR) {
+                return false;
+            }
+        } else if (!conv) {
+            u->kind = SUPH;
+        } else {
+            return false;
+        }
+
+        if ((int)u->t2 == NO_TERR) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    if (n > rest + 1) {
+        return false;
+    }
+
+    u->expect = parse_expect(n > rest ? tok[rest] : NULL);
+
+    return u->expect != -2;
+}
+
+static struct unit_line *find_unit(struct datc_case *c, enum cd_terr t)
+{
+    size_t i;
+    for (i = 0; i < c->units_n; i++) {
+        if (c->units[i].tc.terr == t) {
+            return &c->units[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void parse_dislodged(char *s, enum cd_terr list[], size_t *n)
+{
+    char *t = strtok(s, " \t\n");
+    while (t != NULL && *n < MAX_UNITS) {
+        list[(*n)++] = parse_terr(t);
+        t = strtok(NULL, " \t\n");
+    }
+}
+
+static bool load_cases(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char line[256];
+    int lineno = 0;
+    struct datc_case *c = NULL;
+    struct step *step = NULL;
+
+    while (fgets(line, sizeof line, f)) {
+        lineno++;
+
+        char *s = line + strspn(line, " \t");
+
+        if (*s == '#' || *s == '\n' || *s == '\0') {
+            continue;
+        }
+
+        if (strncmp(s, "case ", 5) == 0) {
+            if (cases_n == MAX_CASES) {
+                fprintf(stderr, "%s:%d: too many cases\n", path, lineno);
+                fclose(f);
+                return false;
+            }
+
+            c = &cases[cases_n++];
+            memset(c, 0, sizeof *c);
+
+            s[strcspn(s, "\n")] = '\0';
+            snprintf(c->name, sizeof c->name, "%s", s + 5);
+            c->line = lineno;
+            step = NULL;
+
+            continue;
+        }
+
+        if (c == NULL) {
+            fprintf(stderr, "%s:%d: expected `case'\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+
+        if (strncmp(s, "dislodged", 9) == 0 && step != NULL) {
+            step->check_dislodged = true;
+            parse_dislodged(s + 9, step->dislodged, &step->dislodged_n);
+
+            continue;
+        }
+
+        if (strncmp(s, "dislodged", 9) == 0) {
+            c->check_dislodged = true;
+            parse_dislodged(s + 9, c->dislodged, &c->dislodged_n);
+
+            continue;
+        }
+
+        /* A case has at most one of the two blocks */
+        if (step == NULL && strcspn(s, " \t\n") == 4
+            && (strncmp(s, "then", 4) == 0 || strncmp(s, "next", 4) == 0)) {
+
+            step = *s == 't' ? &c->then : &c->next;
+            continue;
+        }
+
+        if (step != NULL) {
+            struct unit_line *u = &step->lines[step->lines_n];
+
+            /* Changes replace orders of units placed by the case; after
+             * `next' units may be anywhere they could have moved to */
+            if (step->lines_n == MAX_UNITS || !parse_unit(s, u)
+                || (step == &c->then && find_unit(c, u->tc.terr) == NULL)) {
+
+                fprintf(stderr, "%s:%d: invalid order\n", path, lineno);
+                fclose(f);
+                return false;
+            }
+
+            step->lines_n++;
+            continue;
+        }
+
+        bool illegal = strncmp(s, "illegal ", 8) == 0;
+        struct unit_line *u = &c->units[c->units_n];
+
+        if (c->units_n == MAX_UNITS
+            || !parse_unit(illegal ? s + 8 : s, u)
+            || (illegal && u->expect >= 0)) {
+
+            fprintf(stderr, "%s:%d: invalid unit line\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+
+        u->illegal = illegal;
+        c->units_n++;
+    }
+
+    fclose(f);
+    return true;
+}
+
+/* Gives the order through the same checks as the prompt */
+static bool enter_line(const struct unit_line *u)
+{
+    enum cd_terr t1 = u->tc.terr;
+
+    struct order o = {
+        u->kind, t1, u->kind == MOVE ? t1 : u->t2, {u->t3c.terr},
+        u->t3c.coast, u->viac
+    };
+
+    return enter_order(u->nat, &o);
+}
+
+static bool setup_case(struct datc_case *c)
+{
+    clear_all();
+    delete_all_orders();
+
+    size_t i;
+    for (i = 0; i < c->units_n; i++) {
+        struct unit_line *u = &c->units[i];
+
+        tclist_t l = tclist_cons(u->tc);
+        set_terrs(l, u->unit, u->nat);
+        tclist_free(l);
+    }
+
+    bool ok = true;
+
+    for (i = 0; i < c->units_n; i++) {
+        struct unit_line *u = &c->units[i];
+
+        if (!u->illegal && !enter_line(u)) {
+            printf("FAIL: %s: %s %s: order rejected\n",
+                   c->name,
+                   get_nation_name(u->nat),
+                   get_terr_name(u->tc.terr));
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+/* Orders on `illegal' lines must be turned down when entered, leaving
+ * the unit without an order */
+static bool check_illegal(struct datc_case *c)
+{
+    bool ok = true;
+
+    size_t i;
+    for (i = 0; i < c->units_n; i++) {
+        struct unit_line *u = &c->units[i];
+
+        if (!u->illegal) {
+            continue;
+        }
+
+        capture_begin();
+        bool accepted = enter_line(u);
+        char *out = capture_end();
+
+        const struct order *orders;
+        size_t n = nation_orders(u->nat, &orders);
+
+        if (accepted || strstr(out, "Illegal order") == NULL
+            || find_order(u->nat, u->tc.terr) < n) {
+
+            printf("FAIL: %s: %s %s: illegal order accepted\n",
+                   c->name,
+                   get_nation_name(u->nat),
+                   get_terr_name(u->tc.terr));
+            ok = false;
+        }
+
+        free(out);
+    }
+
+    return ok;
+}
+
+static bool check_outcomes(struct datc_case *c,
+                           struct unit_line lines[],
+                           size_t lines_n)
+{
+    bool ok = true;
+
+    size_t i;
+    for (i = 0; i < lines_n; i++) {
+        struct unit_line *u = &lines[i];
+
+        if (u->expect < 0) {
+            continue;
+        }
+
+        enum outcome got = get_outcome(u->nat, u->tc.terr);
+
+        if ((int)got != u->expect) {
+            printf("FAIL: %s: %s %s: expected %s, got %s\n",
+                   c->name,
+                   get_nation_name(u->nat),
+                   get_terr_name(u->tc.terr),
+                   u->expect == SUCCESS ? "succeeds" : "fails",
+                   got == SUCCESS ? "succeeds"
+                 : got == FAILURE ? "fails"
+                 : "ignored");
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+static bool check_dislodged(struct datc_case *c,
+                            enum cd_terr list[],
+                            size_t list_n)
+{
+    bool ok = true;
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        bool expected = false;
+
+        size_t i;
+        for (i = 0; i < list_n; i++) {
+            if (list[i] == t) {
+                expected = true;
+            }
+        }
+
+        if (expected != dislodged(t)) {
+            printf("FAIL: %s: %s %s dislodged\n",
+                   c->name,
+                   get_terr_name(t),
+                   expected ? "not" : "unexpectedly");
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+static bool check_case(struct datc_case *c)
+{
+    bool ok = check_outcomes(c, c->units, c->units_n);
+
+    if (c->check_dislodged) {
+        ok = check_dislodged(c, c->dislodged, c->dislodged_n) && ok;
+    }
+
+    return ok;
+}
+
+struct snapshot {
+    enum outcome outcomes[MAX_UNITS];
+    bool dislodged[TERR_N];
+};
+
+static void take_snapshot(struct datc_case *c, struct snapshot *s)
+{
+    size_t i;
+    for (i = 0; i < c->units_n; i++) {
+        s->outcomes[i] = get_outcome(c->units[i].nat, c->units[i].tc.terr);
+    }
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        s->dislodged[t] = dislodged(t);
+    }
+}
+
+/* Compares the current resolution with one taken by another path */
+static bool same_as_snapshot(struct datc_case *c,
+                             const struct snapshot *s,
+                             const char *what)
+{
+    bool ok = true;
+
+    size_t i;
+    for (i = 0; i < c->units_n; i++) {
+        struct unit_line *u = &c->units[i];
+
+        if (get_outcome(u->nat, u->tc.terr) != s->outcomes[i]) {
+            printf("FAIL: %s: %s %s: %s outcome differs\n",
+                   c->name, get_nation_name(u->nat),
+                   get_terr_name(u->tc.terr), what);
+            ok = false;
+        }
+    }
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        if (dislodged(t) != s->dislodged[t]) {
+            printf("FAIL: %s: %s: %s dislodgement differs\n",
+                   c->name, get_terr_name(t), what);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+/* Changes the orders listed by the `then' block after a first
+ * resolution and re-resolves with verification on: only the clusters
+ * touched may be re-run, and the result must match a full adjudication
+ * of the same orders entered from scratch. Going back to the first
+ * orders must then find them in the resolution cache. */
+static bool check_then(struct datc_case *c)
+{
+    if (c->then.lines_n == 0) {
+        return true;
+    }
+
+    bool ok = true;
+
+    setup_case(c);
+    cache_clear();
+    resolve_orders();
+
+    size_t incremental = resolved_incrementally;
+    size_t mismatches = verify_mismatches;
+
+    size_t i;
+    for (i = 0; i < c->then.lines_n; i++) {
+        enter_line(&c->then.lines[i]);
+    }
+
+    set_verify(true);
+    resolve_orders();
+    set_verify(false);
+
+    if (resolved_incrementally != incremental + 1) {
+        printf("FAIL: %s: changes not resolved incrementally\n", c->name);
+        ok = false;
+    }
+
+    if (verify_mismatches != mismatches) {
+        printf("FAIL: %s: incremental resolution does not match full "
+               "adjudication\n", c->name);
+        ok = false;
+    }
+
+    ok = check_outcomes(c, c->then.lines, c->then.lines_n) && ok;
+
+    if (c->then.check_dislodged) {
+        ok = check_dislodged(c, c->then.dislodged, c->then.dislodged_n)
+             && ok;
+    }
+
+    struct snapshot changed;
+    take_snapshot(c, &changed);
+
+    size_t hits = cache_hits;
+
+    for (i = 0; i < c->then.lines_n; i++) {
+        enter_line(find_unit(c, c->then.lines[i].tc.terr));
+    }
+
+    resolve_orders();
+
+    if (cache_hits != hits + 1) {
+        printf("FAIL: %s: first orders not found in cache\n", c->name);
+        ok = false;
+    }
+
+    ok = check_case(c) && ok;
+
+    setup_case(c);
+
+    for (i = 0; i < c->then.lines_n; i++) {
+        enter_line(&c->then.lines[i]);
+    }
+
+    cache_clear();
+    resolve_orders();
+
+    return same_as_snapshot(c, &changed, "incremental") && ok;
+}
+
+/* Carries out the first orders as 'run' would, then gives the orders
+ * of the `next' block to the units where they now stand */
+static bool check_next(struct datc_case *c)
+{
+    if (c->next.lines_n == 0) {
+        return true;
+    }
+
+    bool ok = true;
+
+    setup_case(c);
+    cache_clear();
+
+    /* Always from spring to autumn, so that no builds are due */
+    season = SPRING;
+
+    capture_begin();
+    adjudicate();
+    adjudication_wait();
+    free(capture_end());
+
+    size_t i;
+    for (i = 0; i < c->next.lines_n; i++) {
+        struct unit_line *u = &c->next.lines[i];
+
+        if (!enter_line(u)) {
+            printf("FAIL: %s: %s %s: order rejected after moving\n",
+                   c->name,
+                   get_nation_name(u->nat),
+                   get_terr_name(u->tc.terr));
+            ok = false;
+        }
+    }
+
+    resolve_orders();
+
+    ok = check_outcomes(c, c->next.lines, c->next.lines_n) && ok;
+
+    if (c->next.check_dislodged) {
+        ok = check_dislodged(c, c->next.dislodged, c->next.dislodged_n)
+             && ok;
+    }
+
+    return ok;
+}
+
+static int ulong_cmp(const void *x, const void *y)
+{
+    unsigned long a = *(const unsigned long *)x;
+    unsigned long b = *(const unsigned long *)y;
+
+    return a < b ? -1
+         : a > b ? 1
+         : 0;
+}
+
+static unsigned long now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static unsigned long time_case(struct datc_case *c)
+{
+    unsigned long samples[REPS];
+
+    size_t i;
+    for (i = 0; i < REPS; i++) {
+        setup_case(c);
+        cache_clear();
+
+        unsigned long t0 = now_ns();
+        resolve_orders();
+        samples[i] = now_ns() - t0;
+    }
+
+    qsort(samples, REPS, sizeof samples[0], ulong_cmp);
+
+    return samples[REPS / 2];
+}
+
+static struct datc_case *find_case(const char *name)
+{
+    size_t i;
+    for (i = 0; i < cases_n; i++) {
+        if (strcmp(cases[i].name, name) == 0) {
+            return &cases[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool compare_baseline(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        puts("FAIL: no latency baseline, run `make bench-baseline'");
+        return false;
+    }
+
+    const char *env = getenv("DATC_THRESHOLD");
+    unsigned long threshold = env != NULL ? strtoul(env, NULL, 10) : 50;
+
+    bool ok = true;
+    bool seen[MAX_CASES] = {false};
+    char line[256];
+
+    while (fgets(line, sizeof line, f)) {
+        char *sep = strrchr(line, '\t');
+        if (sep == NULL) {
+            continue;
+        }
+
+        *sep = '\0';
+
+        struct datc_case *c = find_case(line);
+        if (c == NULL) {
+            continue;
+        }
+
+        seen[c - cases] = true;
+
+        unsigned long base = strtoul(sep + 1, NULL, 10);
+        unsigned long limit = base + base * threshold / 100;
+
+        if (c->ns > limit && c->ns > base + SLACK_NS) {
+            printf("SLOW: %s: %lu ns, baseline %lu ns (+%lu%%)\n",
+                   c->name, c->ns, base, (c->ns - base) * 100 / base);
+            ok = false;
+        }
+    }
+
+    fclose(f);
+
+    size_t i;
+    for (i = 0; i < cases_n; i++) {
+        if (!seen[i]) {
+            printf("FAIL: %s: not in the baseline\n", cases[i].name);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+static bool record_baseline(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; i < cases_n; i++) {
+        fprintf(f, "%s\t%lu\n", cases[i].name, cases[i].ns);
+    }
+
+    fclose(f);
+    printf("Baseline written to %s\n", path);
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    bool bench = false;
+    bool record = false;
+
+    int a = 1;
+    if (a < argc && strcmp(argv[a], "--bench") == 0) {
+        bench = true;
+        a++;
+    } else if (a < argc && strcmp(argv[a], "--record") == 0) {
+        record = true;
+        a++;
+    }
+
+    const char *cases_path = a < argc ? argv[a++] : getenv("DATC_CASES");
+    const char *base_path = a < argc ? argv[a++] : getenv("DATC_BASELINE");
+
+    if (cases_path == NULL) {
+        fputs("usage: datc [--bench | --record] [CASES [BASELINE]]\n",
+              stderr);
+        return 2;
+    }
+
+    if (!load_cases(cases_path)) {
+        return 2;
+    }
+
+    board_init();
+    game_init();
+
+    size_t failed = 0;
+
+    size_t i;
+    for (i = 0; i < cases_n; i++) {
+        struct datc_case *c = &cases[i];
+
+        bool ok = setup_case(c) && check_illegal(c);
+
+        resolve_orders();
+
+        ok = check_case(c) && ok;
+        ok = check_then(c) && ok;
+        ok = check_next(c) && ok;
+
+        if (!ok) {
+            failed++;
+        }
+
+        c->ns = time_case(c);
+
+        if (bench) {
+            printf("%-56s %8lu ns\n", c->name, c->ns);
+        }
+    }
+
+    printf("%zu/%zu cases passed\n", cases_n - failed, cases_n);
+
+    bool ok = failed == 0;
+
+    if (base_path != NULL) {
+        if (record) {
+            ok = record_baseline(base_path) && ok;
+        } else {
+            ok = compare_baseline(base_path) && ok;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Deletes, withdraws and replaces orders, and checks after every step
+ * that the views kept up to date along the way print the same as when
+ * the remaining orders are entered again from scratch. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "submit.h"
+#include "targets.h"
+
+#include "capture.h"
+
+static const char *opening[] = {
+    "Austria vie-gal", "Austria bud s vie-gal", "Austria tri-ven",
+    "England lon-nth", "England edi-nwg", "England lvp-yor",
+    "France par-bur", "France mar s par-bur", "France bre-eng",
+    "Germany mun-bur", "Germany kie-hol", "Germany ber-kie",
+    "Italy ven-tri", "Italy rom-ven", "Italy nap-ion",
+    "Russia war-gal", "Russia sev-bla", "Russia mos-ukr",
+    "Russia stp-bot",
+    "Turkey ank-bla", "Turkey con-bul", "Turkey smy-arm",
+    NULL
+};
+
+static size_t failed = 0;
+
+/* Everything the incrementally kept state shows */
+static char *render()
+{
+    capture_begin();
+
+    enum cd_terr t;
+    for (t = 0; t < TERR_N; t++) {
+        print_orders_into(t);
+    }
+
+    print_conflicts();
+
+    list_all_orders();
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        list_orders(1u << nat_i);
+    }
+
+    return capture_end();
+}
+
+/* Enters the orders still given, in the same order, on a clean slate */
+static void rebuild()
+{
+    static struct order saved[NATIONS_N][TERR_N];
+    size_t saved_n[NATIONS_N];
+
+    size_t nat_i, i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        const struct order *orders;
+        saved_n[nat_i] = nation_orders(1u << nat_i, &orders);
+        memcpy(saved[nat_i], orders, saved_n[nat_i] * sizeof *orders);
+    }
+
+    delete_all_orders();
+
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        for (i = 0; i < saved_n[nat_i]; i++) {
+            struct order *o = &saved[nat_i][i];
+
+            register_order(1u << nat_i, o->kind, o->t1, o->t2, o->t3,
+                           o->coast, o->viac);
+        }
+    }
+}
+
+static void check_step(const char *step)
+{
+    char *kept = render();
+    rebuild();
+    char *fresh = render();
+
+    if (strcmp(kept, fresh) != 0) {
+        printf("FAIL: %s: views differ from a rebuild\n"
+               "--- kept\n%s--- rebuilt\n%s", step, kept, fresh);
+        failed++;
+    }
+
+    free(kept);
+    free(fresh);
+}
+
+/* The list of a nation shows `want' and no longer `gone' */
+static void check_listed(enum cd_nation nat, const char *want,
+                         const char *gone)
+{
+    capture_begin();
+    list_orders(nat);
+    char *text = capture_end();
+
+    if (strstr(text, want) == NULL
+        || (gone != NULL && strstr(text, gone) != NULL)) {
+        printf("FAIL: orders of %s: expected `%s'%s%s, got\n%s",
+               get_nation_name(nat), want,
+               gone != NULL ? " without " : "",
+               gone != NULL ? gone : "", text);
+        failed++;
+    }
+
+    free(text);
+}
+
+/* "Nation order", the order in the syntax of the submission queues */
+static void enter(const char *line)
+{
+    char name[16];
+    struct order o;
+
+    size_t len = strcspn(line, " ");
+    snprintf(name, sizeof name, "%.*s", (int)len, line);
+
+    if (!submit_parse(line + len, &o)
+        || !enter_order(get_nation(name), &o)) {
+        printf("FAIL: cannot enter `%s'\n", line);
+        exit(1);
+    }
+}
+
+static unsigned orders_given()
+{
+    unsigned n = 0;
+
+    size_t nat_i;
+    for (nat_i = 0; nat_i < NATIONS_N; nat_i++) {
+        const struct order *orders;
+        n += nation_orders(1u << nat_i, &orders);
+    }
+
+    return n;
+}
+
+static void delete(unsigned a, unsigned b)
+{
+    rangelist_t r = rangelist_cons((struct range){a, b});
+    delete_orders(r);
+    rangelist_free(r);
+}
+
+int main()
+{
+    board_init();
+    map_init();
+    game_init();
+
+    size_t i;
+    for (i = 0; opening[i] != NULL; i++) {
+        enter(opening[i]);
+    }
+
+    check_step("opening");
+
+    delete(2, 5);
+    check_step("delete a range across two nations");
+
+    rangelist_t r = rangelist_cons((struct range){1, 2});
+    r = rangelist_add(r, (struct range){6, 8});
+    r = rangelist_add(r, (struct range){18, 20});
+    delete_orders(r);
+    rangelist_free(r);
+    check_step("delete several ranges");
+
+    withdraw_order(RUSSIA, SEV);
+    withdraw_order(TURKEY, ANK);
+    check_step("withdraw both sides of a standoff");
+
+    enter("France par-pic");
+    enter("Germany mun-bur");
+    enter("Germany ber-mun");
+    enter("Italy ven h");
+    check_step("replace orders");
+    check_listed(FRANCE, ": PAR-PIC", ": PAR-BUR");
+    check_listed(ITALY, ": VEN H", ": VEN-TRI");
+
+    enter("Russia sev-rum");
+    enter("Austria bud-rum");
+    enter("Turkey ank-arm");
+    check_step("give orders again");
+
+    delete(1, orders_given() + 1);
+    check_step("delete everything");
+    check_listed(AUSTRIA, "No orders from Austria", NULL);
+    check_listed(ENGLAND, "No orders from England", NULL);
+
+    printf("%s\n", failed == 0 ? "order views tests passed"
+                               : "order views tests failed");
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+/*  cdippy-cli - Keeps track of a game of Diplomacy, and adjudicates
+ *               orders automatically
+ *
+ *  Copyright (C) 2018  Simone Cimarelli a.k.a. AquilaIrreale
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Pushes orders for every power from its own thread while the game
+ * thread keeps draining the queues, then checks what 'list' shows, what
+ * 'run' makes of the orders and that late submissions are dropped. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "commons.h"
+#include "board.h"
+#include "game.h"
+#include "map.h"
+#include "submit.h"
+
+#include "capture.h"
+
+#define ROUNDS 2000
+
+/* Each power replays its lines ROUNDS times; "lvp withdraw" and the
+ * second order for Venice exercise withdrawals and replacements, and
+ * "par-mos" must be rejected by the map checks every time */
+static const char *scripts[NATIONS_N][6] = {
+    {"vie-gal", "bud-ser", "tri h"},
+    {"lon-nth", "edi-nwg", "lvp-yor", "lvp withdraw"},
+    {"par-mos", "par-bur", "mar-spa", "bre-mao"},
+    {"kie-den", "ber-kie", "mun-ruh"},
+    {"ven h", "rom-apu", "nap-ion", "ven-pie"},
+    {"stp-bot", "mos-ukr", "war-gal", "sev-bla"},
+    {"ank-bla", "con-bul", "smy-arm"}
+};
+
+static const char *expected_list =
+    "\n"
+    "Austria\n"
+    " 1: VIE-GAL\n"
+    " 2: BUD-SER\n"
+    " 3: TRI H\n"
+    "\n"
+    "England\n"
+    " 4: LON-NTH\n"
+    " 5: EDI-NWG\n"
+    "\n"
+    "France\n"
+    " 6: PAR-BUR\n"
+    " 7: MAR-SPA\n"
+    " 8: BRE-MAO\n"
+    "\n"
+    "Germany\n"
+    " 9: KIE-DEN\n"
+    "10: BER-KIE\n"
+    "11: MUN-RUH\n"
+    "\n"
+    "Italy\n"
+    "12: VEN-PIE\n"
+    "13: ROM-APU\n"
+    "14: NAP-ION\n"
+    "\n"
+    "Russia\n"
+    "15: STP-BOT\n"
+    "16: MOS-UKR\n"
+    "17: WAR-GAL\n"
+    "18: SEV-BLA\n"
+    "\n"
+    "Turkey\n"
+    "19: ANK-BLA\n"
+    "20: CON-BUL\n"
+    "21: SMY-ARM\n"
+    "\n";
+
+static atomic_size_t producers_left = NATIONS_N;
+static size_t failed = 0;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failed++;
+    }
+}
+
+static void push(enum cd_nation nat, const char *line)
+{
+    struct order o;
+
+    if (!submit_parse(line, &o)) {
+        printf("FAIL: cannot parse `%s'\n", line);
+        exit(1);
+    }
+
+    while (!submit_order(nat, &o)) {
+        nanosleep(&(struct timespec){0, 1000}, NULL);
+    }
+}
+
+static void *producer(void *data)
+{
+    size_t i = (size_t)(uintptr_t)data;
+
+    size_t r, j;
+    for (r = 0; r < ROUNDS; r++) {
+        for (j = 0; scripts[i][j] != NULL; j++) {
+            push(1u << i, scripts[i][j]);
+        }
+    }
+
+    atomic_fetch_sub(&producers_left, 1);
+    return NULL;
+}
+
+static size_t count(const char *text, const char *needle)
+{
+    size_t n = 0;
+
+    const char *p;
+    for (p = text; (p = strstr(p, needle)) != NULL; p++) {
+        n++;
+    }
+
+    return n;
+}
+
+static void test_parse()
+{
+    struct order o;
+
+    check(submit_parse("mao-spa(nc)", &o)
+          && o.kind == MOVE && o.t1 == MAO && o.t2 == MAO
+          && o.t3 == SPA && o.coast == NORTH && !o.viac,
+          "parse move to a coast");
+
+    check(submit_parse("  Lon - Nwy via c\n", &o)
+          && o.kind == MOVE && o.t3 == NWY && o.viac,
+          "parse convoyed move");
+
+    check(submit_parse("nth c lon-nwy", &o)
+          && o.kind == CONV && o.t1 == NTH && o.t2 == LON && o.t3 == NWY,
+          "parse convoy");
+
+    check(submit_parse("mar s par-bur", &o)
+          && o.kind == SUPM && o.t2 == PAR && o.t3 == BUR,
+          "parse support to move");
+
+    check(submit_parse("par withdraw", &o) && o.kind == NULL_ORDER,
+          "parse withdrawal");
+
+    check(!submit_parse("par-xyz", &o), "reject unknown territory");
+    check(!submit_parse("par s", &o), "reject truncated support");
+    check(!submit_parse("par(nc) h", &o), "reject coast on the unit");
+}
+
+int main()
+{
+    board_init();
+    map_init();
+    game_init();
+
+    test_parse();
+
+    pthread_t threads[NATIONS_N];
+
+    size_t i;
+    for (i = 0; i < NATIONS_N; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(uintptr_t)i);
+    }
+
+    capture_begin();
+
+    while (atomic_load(&producers_left) > 0) {
+        drain_submissions();
+    }
+
+    for (i = 0; i < NATIONS_N; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    drain_submissions();
+
+    char *drained = capture_end();
+    check(count(drained, "Illegal order: PAR-MOS") == ROUNDS,
+          "illegal order rejected on every drain");
+    free(drained);
+
+    capture_begin();
+    list_all_orders();
+    char *list = capture_end();
+
+    if (strcmp(list, expected_list) != 0) {
+        printf("FAIL: list after drain:\n%s", list);
+        failed++;
+    }
+
+    free(list);
+
+    capture_begin();
+    adjudicate();
+    adjudication_wait();
+    free(capture_end());
+
+    check(board[BUR].occupier == FRANCE, "PAR-BUR executed");
+    check(board[PAR].occupier == NO_NATION, "PAR vacated");
+    check(board[VIE].occupier == AUSTRIA && board[WAR].occupier == RUSSIA,
+          "VIE-GAL and WAR-GAL bounced");
+    check(board[LVP].occupier == ENGLAND, "withdrawn LVP-YOR not executed");
+    check(board[PIE].occupier == ITALY && board[VEN].occupier == NO_NATION,
+          "replacement VEN-PIE executed");
+
+    /* Queued while the phase ends, as when the worker commits before
+     * the game thread drains again */
+    capture_begin();
+    push(FRANCE, "bur-mun");
+    submit_next_phase();
+    size_t n = drain_submissions();
+    char *late = capture_end();
+
+    check(n == 0 && strstr(late, "France: order for BUR given in an "
+                                 "earlier phase, dropped") != NULL,
+          "order from an earlier phase dropped");
+    free(late);
+
+    const struct order *orders;
+    check(nation_orders(FRANCE, &orders) == 0, "no orders for France");
+
+    printf("%s\n", failed == 0 ? "submission tests passed"
+                               : "submission tests failed");
+
+    return failed == 0 ? 0 : 1;
+}